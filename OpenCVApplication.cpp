@@ -5,7 +5,45 @@
 #include <string>
 #include <iostream>
 #include <queue>
+#include <deque>
 #include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <climits>
+#include <functional>
+#include <array>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#ifdef HAVE_OPENCV_FREETYPE
+#include <opencv2/freetype.hpp>
+#endif
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CLEARTEXT_X86 1
+#include <immintrin.h>
+#else
+#define CLEARTEXT_X86 0
+#endif
 
 using namespace cv;
 using namespace std;
@@ -14,14 +52,665 @@ struct TextBlockClearText {
     Rect boundingBox;
     string transcribedText;
     bool isValidated;
+    int id;
 
-    TextBlockClearText(Rect box) : boundingBox(box), isValidated(false) {}
+    TextBlockClearText(Rect box, int blockId = -1) : boundingBox(box), isValidated(false), id(blockId) {}
 };
 
-static vector<TextBlockClearText>* g_textBlocksClearText = nullptr;
+// Uniform grid over item rectangles for point and rectangle queries. Items are
+// small non-negative integers (block ids, indices, ...) and each one is listed in
+// every cell its rectangle touches. A rectangle query reports an item only from
+// the first cell of its overlap with the query, so there are no duplicates.
+struct RectGridIndexClearText {
+    Rect bounds;
+    int cellSize = 64;
+    int gridCols = 0;
+    int gridRows = 0;
+    vector<vector<int>> cells;
+    vector<Rect> itemRects;
+
+    static int suggestCellSize(Size area, size_t numItems) {
+        double cell = sqrt((double)area.width * area.height / max<size_t>(1, numItems));
+        return min(1024, max(16, (int)cell));
+    }
+
+    void reset(Rect area, int cell) {
+        bounds = area;
+        cellSize = max(1, cell);
+        gridCols = max(1, (area.width + cellSize - 1) / cellSize);
+        gridRows = max(1, (area.height + cellSize - 1) / cellSize);
+        cells.assign((size_t)gridCols * gridRows, vector<int>());
+        itemRects.clear();
+    }
+
+    // Cells touched by r, as an inclusive range in cell coordinates.
+    bool cellRange(const Rect& r, int& cx0, int& cy0, int& cx1, int& cy1) const {
+        Rect clipped = r & bounds;
+        if (clipped.empty()) {
+            return false;
+        }
+        cx0 = (clipped.x - bounds.x) / cellSize;
+        cy0 = (clipped.y - bounds.y) / cellSize;
+        cx1 = (clipped.x + clipped.width - 1 - bounds.x) / cellSize;
+        cy1 = (clipped.y + clipped.height - 1 - bounds.y) / cellSize;
+        return true;
+    }
+
+    void insert(int item, const Rect& r) {
+        if (item >= (int)itemRects.size()) {
+            itemRects.resize(item + 1);
+        }
+        itemRects[item] = r & bounds;
+
+        int cx0, cy0, cx1, cy1;
+        if (!cellRange(r, cx0, cy0, cx1, cy1)) {
+            return;
+        }
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                cells[(size_t)cy * gridCols + cx].push_back(item);
+            }
+        }
+    }
+
+    void remove(int item) {
+        if (item < 0 || item >= (int)itemRects.size()) {
+            return;
+        }
+        int cx0, cy0, cx1, cy1;
+        if (cellRange(itemRects[item], cx0, cy0, cx1, cy1)) {
+            for (int cy = cy0; cy <= cy1; cy++) {
+                for (int cx = cx0; cx <= cx1; cx++) {
+                    vector<int>& cell = cells[(size_t)cy * gridCols + cx];
+                    auto it = find(cell.begin(), cell.end(), item);
+                    if (it != cell.end()) {
+                        *it = cell.back();
+                        cell.pop_back();
+                    }
+                }
+            }
+        }
+        itemRects[item] = Rect();
+    }
+
+    void update(int item, const Rect& r) {
+        remove(item);
+        insert(item, r);
+    }
+
+    template <typename Visit>
+    void queryPoint(Point p, Visit visit) const {
+        if (!bounds.contains(p)) {
+            return;
+        }
+        const vector<int>& cell = cells[(size_t)((p.y - bounds.y) / cellSize) * gridCols + (p.x - bounds.x) / cellSize];
+        for (int item : cell) {
+            if (itemRects[item].contains(p)) {
+                visit(item);
+            }
+        }
+    }
+
+    template <typename Visit>
+    void queryRect(const Rect& r, Visit visit) const {
+        int cx0, cy0, cx1, cy1;
+        if (!cellRange(r, cx0, cy0, cx1, cy1)) {
+            return;
+        }
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                for (int item : cells[(size_t)cy * gridCols + cx]) {
+                    Rect overlap = itemRects[item] & r;
+                    if (overlap.empty()) {
+                        continue;
+                    }
+                    if ((overlap.x - bounds.x) / cellSize == cx && (overlap.y - bounds.y) / cellSize == cy) {
+                        visit(item);
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Blocks of one page keyed by stable ids: deleting a block only tombstones it,
+// so ids (and the numbers shown to the user) never shift. Storage and index are
+// compacted once half of the entries are dead. Overlapping hits resolve to the
+// smallest block, then to the lowest id.
+struct TextBlockStoreClearText {
+    vector<TextBlockClearText> blocks;
+    vector<bool> deleted;
+    vector<int> slotOfId;
+    RectGridIndexClearText grid;
+    size_t numDeleted = 0;
+
+    void reset(const vector<TextBlockClearText>& textBlocks, Size imageSize) {
+        blocks = textBlocks;
+        deleted.assign(blocks.size(), false);
+        numDeleted = 0;
+
+        int nextId = 0;
+        for (const auto& block : blocks) {
+            nextId = max(nextId, block.id + 1);
+        }
+        for (auto& block : blocks) {
+            if (block.id < 0) {
+                block.id = nextId++;
+            }
+        }
+
+        grid.reset(Rect(0, 0, imageSize.width, imageSize.height),
+            RectGridIndexClearText::suggestCellSize(imageSize, blocks.size()));
+        rebuildIndex(nextId);
+    }
+
+    void rebuildIndex(int idLimit) {
+        slotOfId.assign(idLimit, -1);
+        grid.reset(grid.bounds, grid.cellSize);
+        for (size_t slot = 0; slot < blocks.size(); slot++) {
+            slotOfId[blocks[slot].id] = (int)slot;
+            grid.insert(blocks[slot].id, blocks[slot].boundingBox);
+        }
+    }
+
+    size_t size() const {
+        return blocks.size() - numDeleted;
+    }
+
+    int idLimit() const {
+        return (int)slotOfId.size();
+    }
+
+    TextBlockClearText* find(int id) {
+        int slot = id >= 0 && id < idLimit() ? slotOfId[id] : -1;
+        return slot >= 0 && !deleted[slot] ? &blocks[slot] : nullptr;
+    }
+
+    const TextBlockClearText* find(int id) const {
+        return const_cast<TextBlockStoreClearText*>(this)->find(id);
+    }
+
+    bool remove(int id) {
+        TextBlockClearText* block = find(id);
+        if (!block) {
+            return false;
+        }
+        deleted[slotOfId[id]] = true;
+        numDeleted++;
+        if (numDeleted * 2 > blocks.size()) {
+            compact();
+        }
+        return true;
+    }
+
+    void compact() {
+        size_t live = 0;
+        for (size_t slot = 0; slot < blocks.size(); slot++) {
+            if (!deleted[slot]) {
+                blocks[live++] = move(blocks[slot]);
+            }
+        }
+        blocks.erase(blocks.begin() + live, blocks.end());
+        deleted.assign(blocks.size(), false);
+        numDeleted = 0;
+        rebuildIndex(idLimit());
+    }
+
+    int hitTest(Point p) const {
+        int best = -1;
+        grid.queryPoint(p, [&](int id) {
+            const TextBlockClearText* block = find(id);
+            if (!block) {
+                return;
+            }
+            const TextBlockClearText* current = best >= 0 ? find(best) : nullptr;
+            if (!current || block->boundingBox.area() < current->boundingBox.area() ||
+                (block->boundingBox.area() == current->boundingBox.area() && id < best)) {
+                best = id;
+            }
+        });
+        return best;
+    }
+
+    // Live blocks overlapping r, ordered by id.
+    void query(const Rect& r, vector<int>& ids) const {
+        ids.clear();
+        grid.queryRect(r, [&](int id) {
+            if (find(id)) {
+                ids.push_back(id);
+            }
+        });
+        sort(ids.begin(), ids.end());
+    }
+
+    void exportBlocks(vector<TextBlockClearText>& out) const {
+        out.clear();
+        for (size_t slot = 0; slot < blocks.size(); slot++) {
+            if (!deleted[slot]) {
+                out.push_back(blocks[slot]);
+            }
+        }
+    }
+};
+
+static TextBlockStoreClearText* g_blockStoreClearText = nullptr;
 static int g_selectedBlockClearText = -1;
 static double g_displayScaleClearText = 1.0;
 static bool g_needsUpdateClearText = true;
+static bool g_verboseClearText = true;
+
+// Stage timers and counters, written as a Chrome trace-event JSON file per page
+// (open it in Perfetto or chrome://tracing). Build with CLEARTEXT_TRACE=1 to
+// enable; otherwise the TRACE_* macros expand to nothing, arguments included.
+#ifndef CLEARTEXT_TRACE
+#define CLEARTEXT_TRACE 0
+#endif
+
+#if CLEARTEXT_TRACE
+struct TraceEventClearText {
+    const char* name;
+    char phase;
+    int64 timestamp;
+    int64 duration;
+    int64 value;
+};
+
+struct TraceRecorderClearText {
+    int64 startTicks;
+    vector<TraceEventClearText> events;
+
+    TraceRecorderClearText() : startTicks(getTickCount()) {}
+
+    int64 microseconds(int64 ticks) const {
+        return (int64)((ticks - startTicks) * 1e6 / getTickFrequency());
+    }
+
+    bool writeJson(const string& path) const {
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f) {
+            return false;
+        }
+        fprintf(f, "{\"traceEvents\":[\n");
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEventClearText& e = events[i];
+            if (e.phase == 'X') {
+                fprintf(f, "{\"name\":\"%s\",\"cat\":\"cleartext\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%lld}",
+                    e.name, (long long)e.timestamp, (long long)e.duration);
+            }
+            else {
+                fprintf(f, "{\"name\":\"%s\",\"cat\":\"cleartext\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"args\":{\"value\":%lld}}",
+                    e.name, (long long)e.timestamp, (long long)e.value);
+            }
+            fprintf(f, i + 1 < events.size() ? ",\n" : "\n");
+        }
+        fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(f);
+        return true;
+    }
+};
+
+// Only the thread that owns the page records; pool workers running the bands of
+// a stage are covered by the stage's own scope.
+static thread_local TraceRecorderClearText* g_traceRecorderClearText = nullptr;
+
+struct ScopedTraceClearText {
+    const char* name;
+    int64 startTicks;
+
+    ScopedTraceClearText(const char* stageName) : name(stageName), startTicks(getTickCount()) {}
+
+    ~ScopedTraceClearText() {
+        TraceRecorderClearText* recorder = g_traceRecorderClearText;
+        if (recorder) {
+            int64 start = recorder->microseconds(startTicks);
+            recorder->events.push_back({ name, 'X', start, recorder->microseconds(getTickCount()) - start, 0 });
+        }
+    }
+};
+
+void traceCounterClearText(const char* name, int64 value) {
+    TraceRecorderClearText* recorder = g_traceRecorderClearText;
+    if (recorder) {
+        recorder->events.push_back({ name, 'C', recorder->microseconds(getTickCount()), 0, value });
+    }
+}
+
+struct TracePageClearText {
+    string path;
+    TraceRecorderClearText recorder;
+    TraceRecorderClearText* previous;
+
+    TracePageClearText(const string& outputPath) : path(outputPath), previous(g_traceRecorderClearText) {
+        g_traceRecorderClearText = &recorder;
+    }
+
+    ~TracePageClearText() {
+        g_traceRecorderClearText = previous;
+        if (!recorder.writeJson(path)) {
+            printf("Nu am putut scrie trace-ul: %s\n", path.c_str());
+        }
+    }
+};
+
+#define TRACE_CONCAT_INNER_CLEARTEXT(a, b) a##b
+#define TRACE_CONCAT_CLEARTEXT(a, b) TRACE_CONCAT_INNER_CLEARTEXT(a, b)
+#define TRACE_SCOPE_CLEARTEXT(name) ScopedTraceClearText TRACE_CONCAT_CLEARTEXT(traceScope, __LINE__)(name)
+#define TRACE_COUNTER_CLEARTEXT(name, value) traceCounterClearText(name, (int64)(value))
+#define TRACE_PAGE_CLEARTEXT(path) TracePageClearText TRACE_CONCAT_CLEARTEXT(tracePage, __LINE__)(path)
+#else
+#define TRACE_SCOPE_CLEARTEXT(name)
+#define TRACE_COUNTER_CLEARTEXT(name, value)
+#define TRACE_PAGE_CLEARTEXT(path)
+#endif
+
+// Tasks submitted together; wait() returns once all of them ran and rethrows
+// the first exception one of them threw.
+struct TaskGroupClearText {
+    atomic<int> pending{ 0 };
+    mutex doneMutex;
+    condition_variable done;
+    exception_ptr error;
+};
+
+// Index of the current thread in the task pool, -1 outside it.
+static thread_local int g_poolWorkerClearText = -1;
+
+// Work-stealing pool shared by the whole-page tasks of batch mode and the
+// band/strip tasks inside the stages. Each worker pushes and pops its own tasks
+// at the back of its deque and, when that is empty, steals from the front of
+// the others', where the oldest and largest tasks are. A worker waiting for a
+// group runs queued tasks in the meantime, so nested parallelism (the bands of
+// a 600 dpi page next to many small pages) balances itself on the same threads.
+// Threads outside the pool submit to a shared queue and block in wait(); only
+// idle workers start those tasks, so a waiting worker helps with bands but does
+// not open another page.
+struct WorkStealingPoolClearText {
+    struct TaskClearText {
+        function<void()> run;
+        TaskGroupClearText* group;
+    };
+
+    struct WorkerClearText {
+        mutex dequeMutex;
+        deque<TaskClearText> tasks;
+        thread handle;
+        atomic<int64> busyTicks{ 0 };
+        atomic<int64> waitTicks{ 0 };
+        atomic<int64> tasksRun{ 0 };
+        atomic<int64> tasksStolen{ 0 };
+        int depth = 0;
+    };
+
+    vector<unique_ptr<WorkerClearText>> workers;
+    mutex sharedMutex;
+    deque<TaskClearText> shared;
+    mutex sleepMutex;
+    condition_variable wake;
+    atomic<int> queued{ 0 };
+    bool stopping = false;
+    int64 countersStart = getTickCount();
+
+    WorkStealingPoolClearText(int numWorkers, bool pinToCpus) {
+        numWorkers = max(1, numWorkers);
+        for (int i = 0; i < numWorkers; i++) {
+            workers.push_back(make_unique<WorkerClearText>());
+        }
+        vector<int> cpus = pinToCpus ? allowedCpus() : vector<int>();
+        if (pinToCpus && cpus.empty()) {
+            printf("Nu am putut citi procesoarele permise, firele nu sunt fixate\n");
+        }
+        for (int i = 0; i < numWorkers; i++) {
+            workers[i]->handle = thread([this, i]() { workerLoop(i); });
+            if (!cpus.empty()) {
+                int cpu = cpus[i % cpus.size()];
+                if (!pinThread(workers[i]->handle, cpu)) {
+                    printf("Nu am putut fixa firul %d pe procesorul %d\n", i, cpu);
+                }
+            }
+        }
+    }
+
+    ~WorkStealingPoolClearText() {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker->handle.join();
+        }
+    }
+
+    // CPUs the process may run on (its affinity mask, so taskset and container
+    // cpusets are respected), in increasing order; empty if it cannot be read.
+    static vector<int> allowedCpus() {
+        vector<int> cpus;
+#ifdef _WIN32
+        DWORD_PTR processMask, systemMask;
+        if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+            for (int cpu = 0; cpu < (int)(8 * sizeof(DWORD_PTR)); cpu++) {
+                if ((processMask >> cpu) & 1) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        return cpus;
+    }
+
+    // cpu comes from allowedCpus(), so it fits in the mask on both platforms.
+    static bool pinThread(thread& t, int cpu) {
+#ifdef _WIN32
+        return SetThreadAffinityMask((HANDLE)t.native_handle(), (DWORD_PTR)1 << cpu) != 0;
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) == 0;
+#endif
+    }
+
+    int size() const { return (int)workers.size(); }
+
+    void submit(TaskGroupClearText& group, function<void()> task) {
+        group.pending++;
+        int self = g_poolWorkerClearText;
+        if (self >= 0) {
+            lock_guard<mutex> lock(workers[self]->dequeMutex);
+            workers[self]->tasks.push_back({ move(task), &group });
+        }
+        else {
+            lock_guard<mutex> lock(sharedMutex);
+            shared.push_back({ move(task), &group });
+        }
+        queued++;
+        {
+            lock_guard<mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Own deque from the back, then the shared queue, then the other deques
+    // from the front. Returns false if every queue was empty.
+    bool takeTask(int self, bool fromShared, TaskClearText& task, bool& stolen) {
+        stolen = false;
+        if (self >= 0) {
+            lock_guard<mutex> lock(workers[self]->dequeMutex);
+            if (!workers[self]->tasks.empty()) {
+                task = move(workers[self]->tasks.back());
+                workers[self]->tasks.pop_back();
+                return true;
+            }
+        }
+        if (fromShared) {
+            lock_guard<mutex> lock(sharedMutex);
+            if (!shared.empty()) {
+                task = move(shared.front());
+                shared.pop_front();
+                return true;
+            }
+        }
+        for (int k = 1; k <= size(); k++) {
+            int victim = (max(self, 0) + k) % size();
+            if (victim == self) {
+                continue;
+            }
+            lock_guard<mutex> lock(workers[victim]->dequeMutex);
+            if (!workers[victim]->tasks.empty()) {
+                task = move(workers[victim]->tasks.front());
+                workers[victim]->tasks.pop_front();
+                stolen = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Busy time is counted for the outermost task of a worker only, minus the
+    // time it spent blocked in wait(), so nested tasks are not counted twice.
+    bool runOne(int self, bool fromShared) {
+        TaskClearText task;
+        bool stolen;
+        if (!takeTask(self, fromShared, task, stolen)) {
+            return false;
+        }
+        queued--;
+
+        WorkerClearText& worker = *workers[self];
+        int64 start = getTickCount();
+        worker.depth++;
+        try {
+            task.run();
+        }
+        catch (...) {
+            lock_guard<mutex> lock(task.group->doneMutex);
+            if (!task.group->error) {
+                task.group->error = current_exception();
+            }
+        }
+        worker.depth--;
+        if (worker.depth == 0) {
+            worker.busyTicks += getTickCount() - start;
+        }
+        worker.tasksRun++;
+        if (stolen) {
+            worker.tasksStolen++;
+        }
+
+        lock_guard<mutex> lock(task.group->doneMutex);
+        if (--task.group->pending == 0) {
+            task.group->done.notify_all();
+        }
+        return true;
+    }
+
+    void workerLoop(int self) {
+        g_poolWorkerClearText = self;
+        while (true) {
+            if (runOne(self, true)) {
+                continue;
+            }
+            unique_lock<mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return stopping || queued > 0; });
+            if (stopping && queued == 0) {
+                return;
+            }
+        }
+    }
+
+    void wait(TaskGroupClearText& group) {
+        int self = g_poolWorkerClearText;
+        while (group.pending > 0) {
+            if (self >= 0 && runOne(self, false)) {
+                continue;
+            }
+            int64 start = getTickCount();
+            unique_lock<mutex> lock(group.doneMutex);
+            if (self >= 0) {
+                // Woken up regularly to pick up tasks queued meanwhile.
+                group.done.wait_for(lock, chrono::microseconds(200), [&]() { return group.pending == 0; });
+                workers[self]->waitTicks += getTickCount() - start;
+            }
+            else {
+                group.done.wait(lock, [&]() { return group.pending == 0; });
+            }
+        }
+        // The last task may still be notifying under the lock.
+        lock_guard<mutex> lock(group.doneMutex);
+        if (group.error) {
+            rethrow_exception(group.error);
+        }
+    }
+
+    // Splits range into numChunks contiguous pieces (4 per worker by default)
+    // run as tasks; the calling thread runs the first piece itself.
+    void parallelFor(const Range& range, const function<void(const Range&)>& body, int numChunks = 0) {
+        int n = range.end - range.start;
+        if (n <= 0) {
+            return;
+        }
+        numChunks = min(n, numChunks > 0 ? numChunks : 4 * size());
+
+        TaskGroupClearText group;
+        for (int c = 1; c < numChunks; c++) {
+            Range piece(range.start + (int)((int64)n * c / numChunks), range.start + (int)((int64)n * (c + 1) / numChunks));
+            submit(group, [&body, piece]() { body(piece); });
+        }
+        try {
+            body(Range(range.start, range.start + n / numChunks));
+        }
+        catch (...) {
+            wait(group);
+            throw;
+        }
+        wait(group);
+    }
+
+    void resetCounters() {
+        for (auto& worker : workers) {
+            worker->busyTicks = 0;
+            worker->waitTicks = 0;
+            worker->tasksRun = 0;
+            worker->tasksStolen = 0;
+        }
+        countersStart = getTickCount();
+    }
+
+    void printUtilization() const {
+        double elapsed = (double)(getTickCount() - countersStart);
+        for (int i = 0; i < size(); i++) {
+            const WorkerClearText& worker = *workers[i];
+            double busy = (double)(worker.busyTicks - worker.waitTicks);
+            printf("  Fir %d: %.0f%% ocupat, %lld sarcini (%lld furate)\n", i, elapsed > 0 ? 100.0 * busy / elapsed : 0.0,
+                (long long)worker.tasksRun, (long long)worker.tasksStolen);
+        }
+    }
+};
+
+// Worker count (0 = one per CPU) and pinning of the shared pool; only read when
+// the pool is first used.
+static int g_poolWorkersClearText = 0;
+static bool g_poolAffinityClearText = false;
+
+WorkStealingPoolClearText& taskPoolClearText() {
+    static WorkStealingPoolClearText pool(g_poolWorkersClearText > 0 ? g_poolWorkersClearText : getNumberOfCPUs(),
+        g_poolAffinityClearText);
+    return pool;
+}
+
+void parallelForClearText(const Range& range, const function<void(const Range&)>& body, int numChunks = 0) {
+    taskPoolClearText().parallelFor(range, body, numChunks);
+}
 
 Mat resizeForDisplayClearText(const Mat& img, int maxWidth = 1000, int maxHeight = 700) {
     if (img.empty()) return img;
@@ -33,226 +722,5126 @@ Mat resizeForDisplayClearText(const Mat& img, int maxWidth = 1000, int maxHeight
         double scaleX = (double)maxWidth / img.cols;
         double scaleY = (double)maxHeight / img.rows;
 
-        if (scaleX < scaleY)
-            scale = scaleX;
-        if (scaleX > scaleY)
-            scale = scaleY;
+        if (scaleX < scaleY)
+            scale = scaleX;
+        if (scaleX > scaleY)
+            scale = scaleY;
+
+        int newWidth = (int)(img.cols * scale);
+        int newHeight = (int)(img.rows * scale);
+
+        resize(img, resized, Size(newWidth, newHeight), 0, 0, INTER_AREA);
+        return resized;
+    }
+
+    return img.clone();
+}
+
+int computeAutoThresholdClearText(const int hist[256]) {
+    int T = 128;
+    int T_prev = 0;
+    float error = 0.1f;
+
+    while (abs(T - T_prev) >= error) {
+        T_prev = T;
+        int64 count1 = 0, count2 = 0;
+        int64 sum1 = 0, sum2 = 0;
+
+        for (int i = 0; i < 256; i++) {
+            if (i <= T) {
+                count1 += hist[i];
+                sum1 += (int64)i * hist[i];
+            }
+            else {
+                count2 += hist[i];
+                sum2 += (int64)i * hist[i];
+            }
+        }
+
+        float mean1;
+        if (count1 > 0) {
+            mean1 = (float)sum1 / count1;
+        }
+        else {
+            mean1 = 0;
+        }
+
+        float mean2;
+        if (count2 > 0) {
+            mean2 = (float)sum2 / count2;
+        }
+        else {
+            mean2 = 0;
+        }
+
+        T = (int)((mean1 + mean2) / 2);
+    }
+
+    if (g_verboseClearText) {
+        printf("Prag calculat automat: %d\n", T);
+    }
+
+    return T;
+}
+
+Mat grayscale_to_BW_autoClearText(Mat src) {
+    Mat dst(src.rows, src.cols, CV_8UC1);
+
+    int hist[256] = { 0 };
+    for (int i = 0; i < src.rows; i++) {
+        for (int j = 0; j < src.cols; j++) {
+            hist[src.at<uchar>(i, j)]++;
+        }
+    }
+
+    int T = computeAutoThresholdClearText(hist);
+
+    for (int i = 0; i < src.rows; i++) {
+        for (int j = 0; j < src.cols; j++) {
+            if (src.at<uchar>(i, j) < T) {
+                dst.at<uchar>(i, j) = 0;
+            }
+            else {
+                dst.at<uchar>(i, j) = 255;
+            }
+        }
+    }
+
+    return dst;
+}
+
+// Row kernels, one implementation per instruction set. The scalar set holds the
+// plain loops the pipeline was written with and is the reference: every other
+// set must produce the same bytes, which --verify-kernels checks stage by stage.
+// The set is chosen once at startup from the CPU features (the fastest one
+// supported), or forced with CLEARTEXT_KERNELS=scalar|simd128|avx2.
+void grayRowScalarClearText(const uchar* bgr, uchar* gray, int n) {
+    for (int j = 0; j < n; j++) {
+        const uchar* pixel = bgr + 3 * j;
+        gray[j] = (uchar)((pixel[0] + pixel[1] + pixel[2]) / 3);
+    }
+}
+
+void thresholdRowScalarClearText(const uchar* gray, uchar* dst, int n, uchar t) {
+    for (int j = 0; j < n; j++) {
+        dst[j] = gray[j] < t ? 0 : 255;
+    }
+}
+
+// A pixel below 128 is black: the sign bit the vector sets test with one
+// movemask, so all sets agree on any input, not only on 0/255.
+void packRowScalarClearText(const uchar* src, int cols, uint64* words) {
+    for (int j = 0; j < cols; j += 64) {
+        uint64 word = 0;
+        int end = min(cols, j + 64);
+        for (int t = j; t < end; t++) {
+            word |= (uint64)(src[t] < 128) << (t & 63);
+        }
+        words[j >> 6] = word;
+    }
+}
+
+void minRowsScalarClearText(const uchar* a, const uchar* b, uchar* dst, int n) {
+    for (int j = 0; j < n; j++) {
+        dst[j] = min(a[j], b[j]);
+    }
+}
+
+void maxRowsScalarClearText(const uchar* a, const uchar* b, uchar* dst, int n) {
+    for (int j = 0; j < n; j++) {
+        dst[j] = max(a[j], b[j]);
+    }
+}
+
+void orWordsScalarClearText(uint64* dst, const uint64* src, int n) {
+    for (int w = 0; w < n; w++) {
+        dst[w] |= src[w];
+    }
+}
+
+#if CV_SIMD128
+// x / 3 is computed as (x * 43691) >> 17, exact for x <= 765.
+void grayRowSimd128ClearText(const uchar* bgr, uchar* gray, int n) {
+    const v_uint16x8 div3 = v_setall_u16(43691);
+    int j = 0;
+    for (; j <= n - 16; j += 16) {
+        v_uint8x16 b, g, r;
+        v_load_deinterleave(bgr + 3 * j, b, g, r);
+
+        v_uint16x8 bLo, bHi, gLo, gHi, rLo, rHi;
+        v_expand(b, bLo, bHi);
+        v_expand(g, gLo, gHi);
+        v_expand(r, rLo, rHi);
+
+        v_uint16x8 lo = v_mul_hi(bLo + gLo + rLo, div3) >> 1;
+        v_uint16x8 hi = v_mul_hi(bHi + gHi + rHi, div3) >> 1;
+        v_store(gray + j, v_pack(lo, hi));
+    }
+    grayRowScalarClearText(bgr + 3 * j, gray + j, n - j);
+}
+
+void thresholdRowSimd128ClearText(const uchar* gray, uchar* dst, int n, uchar t) {
+    const v_uint8x16 vt = v_setall_u8(t);
+    int j = 0;
+    for (; j <= n - 16; j += 16) {
+        v_store(dst + j, v_load(gray + j) >= vt);
+    }
+    thresholdRowScalarClearText(gray + j, dst + j, n - j, t);
+}
+
+// 64 pixels per word from 4 sign masks (white = 255 has the sign bit set).
+void packRowSimd128ClearText(const uchar* src, int cols, uint64* words) {
+    int j = 0;
+    for (; j <= cols - 64; j += 64) {
+        uint64 white = (uint64)(unsigned)v_signmask(v_load(src + j)) |
+            (uint64)(unsigned)v_signmask(v_load(src + j + 16)) << 16 |
+            (uint64)(unsigned)v_signmask(v_load(src + j + 32)) << 32 |
+            (uint64)(unsigned)v_signmask(v_load(src + j + 48)) << 48;
+        words[j >> 6] = ~white;
+    }
+    packRowScalarClearText(src + j, cols - j, words + (j >> 6));
+}
+
+void minRowsSimd128ClearText(const uchar* a, const uchar* b, uchar* dst, int n) {
+    int j = 0;
+    for (; j <= n - 16; j += 16) {
+        v_store(dst + j, v_min(v_load(a + j), v_load(b + j)));
+    }
+    minRowsScalarClearText(a + j, b + j, dst + j, n - j);
+}
+
+void maxRowsSimd128ClearText(const uchar* a, const uchar* b, uchar* dst, int n) {
+    int j = 0;
+    for (; j <= n - 16; j += 16) {
+        v_store(dst + j, v_max(v_load(a + j), v_load(b + j)));
+    }
+    maxRowsScalarClearText(a + j, b + j, dst + j, n - j);
+}
+
+void orWordsSimd128ClearText(uint64* dst, const uint64* src, int n) {
+    int w = 0;
+    for (; w <= n - 2; w += 2) {
+        uchar* d = (uchar*)(dst + w);
+        v_store(d, v_load(d) | v_load((const uchar*)(src + w)));
+    }
+    orWordsScalarClearText(dst + w, src + w, n - w);
+}
+#endif
+
+#if CLEARTEXT_X86
+#if defined(__GNUC__) || defined(__clang__)
+#define CLEARTEXT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CLEARTEXT_TARGET_AVX2
+#endif
+
+// pshufb tables for the AVX2 grayscale: each 128-bit lane handles 8 pixels
+// (24 bytes), read as bytes [0, 16) of the lane's pixels from one load and
+// [8, 24) from a second one. Table 2c picks channel c of pixel k into the low
+// byte of 16-bit word k from the first load, table 2c + 1 from the second.
+const uchar* grayShuffleAvx2ClearText() {
+    static const auto tables = []() {
+        array<array<uchar, 32>, 6> t;
+        for (int c = 0; c < 3; c++) {
+            for (int lane = 0; lane < 2; lane++) {
+                for (int k = 0; k < 8; k++) {
+                    int byte = 3 * k + c;
+                    t[2 * c][lane * 16 + 2 * k] = byte < 16 ? (uchar)byte : 0x80;
+                    t[2 * c + 1][lane * 16 + 2 * k] = byte >= 16 ? (uchar)(byte - 8) : 0x80;
+                    t[2 * c][lane * 16 + 2 * k + 1] = 0x80;
+                    t[2 * c + 1][lane * 16 + 2 * k + 1] = 0x80;
+                }
+            }
+        }
+        return t;
+    }();
+    return tables[0].data();
+}
+
+CLEARTEXT_TARGET_AVX2
+void grayRowAvx2ClearText(const uchar* bgr, uchar* gray, int n) {
+    const uchar* tables = grayShuffleAvx2ClearText();
+    __m256i pick[6];
+    for (int t = 0; t < 6; t++) {
+        pick[t] = _mm256_loadu_si256((const __m256i*)(tables + 32 * t));
+    }
+    const __m256i div3 = _mm256_set1_epi16((short)43691);
+
+    int j = 0;
+    for (; j <= n - 16; j += 16) {
+        const uchar* p = bgr + 3 * j;
+        __m256i first = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+            _mm_loadu_si128((const __m128i*)(p + 24)), 1);
+        __m256i second = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(p + 8))),
+            _mm_loadu_si128((const __m128i*)(p + 32)), 1);
+
+        __m256i sum = _mm256_setzero_si256();
+        for (int c = 0; c < 3; c++) {
+            sum = _mm256_add_epi16(sum, _mm256_or_si256(_mm256_shuffle_epi8(first, pick[2 * c]),
+                _mm256_shuffle_epi8(second, pick[2 * c + 1])));
+        }
+        __m256i gray16 = _mm256_srli_epi16(_mm256_mulhi_epu16(sum, div3), 1);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(gray16, gray16), 0x08);
+        _mm_storeu_si128((__m128i*)(gray + j), _mm256_castsi256_si128(packed));
+    }
+    grayRowScalarClearText(bgr + 3 * j, gray + j, n - j);
+}
+
+// x >= t exactly where max(x, t) == x.
+CLEARTEXT_TARGET_AVX2
+void thresholdRowAvx2ClearText(const uchar* gray, uchar* dst, int n, uchar t) {
+    const __m256i vt = _mm256_set1_epi8((char)t);
+    int j = 0;
+    for (; j <= n - 32; j += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(gray + j));
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_cmpeq_epi8(_mm256_max_epu8(x, vt), x));
+    }
+    thresholdRowScalarClearText(gray + j, dst + j, n - j, t);
+}
+
+CLEARTEXT_TARGET_AVX2
+void packRowAvx2ClearText(const uchar* src, int cols, uint64* words) {
+    int j = 0;
+    for (; j <= cols - 64; j += 64) {
+        uint64 white = (uint64)(unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(src + j))) |
+            (uint64)(unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(src + j + 32))) << 32;
+        words[j >> 6] = ~white;
+    }
+    packRowScalarClearText(src + j, cols - j, words + (j >> 6));
+}
+
+CLEARTEXT_TARGET_AVX2
+void minRowsAvx2ClearText(const uchar* a, const uchar* b, uchar* dst, int n) {
+    int j = 0;
+    for (; j <= n - 32; j += 32) {
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_min_epu8(_mm256_loadu_si256((const __m256i*)(a + j)),
+            _mm256_loadu_si256((const __m256i*)(b + j))));
+    }
+    minRowsScalarClearText(a + j, b + j, dst + j, n - j);
+}
+
+CLEARTEXT_TARGET_AVX2
+void maxRowsAvx2ClearText(const uchar* a, const uchar* b, uchar* dst, int n) {
+    int j = 0;
+    for (; j <= n - 32; j += 32) {
+        _mm256_storeu_si256((__m256i*)(dst + j), _mm256_max_epu8(_mm256_loadu_si256((const __m256i*)(a + j)),
+            _mm256_loadu_si256((const __m256i*)(b + j))));
+    }
+    maxRowsScalarClearText(a + j, b + j, dst + j, n - j);
+}
+
+CLEARTEXT_TARGET_AVX2
+void orWordsAvx2ClearText(uint64* dst, const uint64* src, int n) {
+    int w = 0;
+    for (; w <= n - 4; w += 4) {
+        __m256i* d = (__m256i*)(dst + w);
+        _mm256_storeu_si256(d, _mm256_or_si256(_mm256_loadu_si256(d), _mm256_loadu_si256((const __m256i*)(src + w))));
+    }
+    orWordsScalarClearText(dst + w, src + w, n - w);
+}
+#endif
+
+struct KernelSetClearText {
+    const char* name;
+    int cpuFeature;  // CV_CPU_* needed, 0 for none
+    void (*grayRow)(const uchar* bgr, uchar* gray, int n);
+    void (*thresholdRow)(const uchar* gray, uchar* dst, int n, uchar t);
+    void (*packRow)(const uchar* src, int cols, uint64* words);
+    void (*minRows)(const uchar* a, const uchar* b, uchar* dst, int n);
+    void (*maxRows)(const uchar* a, const uchar* b, uchar* dst, int n);
+    void (*orWords)(uint64* dst, const uint64* src, int n);
+};
+
+// From the reference to the fastest.
+static const KernelSetClearText g_kernelSetsClearText[] = {
+    { "scalar", 0, grayRowScalarClearText, thresholdRowScalarClearText, packRowScalarClearText,
+        minRowsScalarClearText, maxRowsScalarClearText, orWordsScalarClearText },
+#if CV_SIMD128
+    { "simd128", CLEARTEXT_X86 ? CV_CPU_SSE2 : CV_CPU_NEON, grayRowSimd128ClearText, thresholdRowSimd128ClearText,
+        packRowSimd128ClearText, minRowsSimd128ClearText, maxRowsSimd128ClearText, orWordsSimd128ClearText },
+#endif
+#if CLEARTEXT_X86
+    { "avx2", CV_CPU_AVX2, grayRowAvx2ClearText, thresholdRowAvx2ClearText, packRowAvx2ClearText,
+        minRowsAvx2ClearText, maxRowsAvx2ClearText, orWordsAvx2ClearText },
+#endif
+};
+
+static const KernelSetClearText* g_kernelsClearText = &g_kernelSetsClearText[0];
+
+bool kernelSetSupportedClearText(const KernelSetClearText& set) {
+    return set.cpuFeature == 0 || checkHardwareSupport(set.cpuFeature);
+}
+
+// The fastest set this CPU supports, unless `requested` names another one it
+// supports.
+const KernelSetClearText* selectKernelSetClearText(const char* requested) {
+    const KernelSetClearText* best = &g_kernelSetsClearText[0];
+    for (const auto& set : g_kernelSetsClearText) {
+        if (kernelSetSupportedClearText(set)) {
+            best = &set;
+        }
+    }
+    if (requested == nullptr || requested[0] == '\0') {
+        return best;
+    }
+
+    for (const auto& set : g_kernelSetsClearText) {
+        if (string(requested) == set.name) {
+            if (kernelSetSupportedClearText(set)) {
+                return &set;
+            }
+            printf("Kernel-urile %s nu sunt suportate de acest procesor, folosesc %s\n", requested, best->name);
+            return best;
+        }
+    }
+    printf("Set de kernel-uri necunoscut: %s, folosesc %s\n", requested, best->name);
+    return best;
+}
+
+// Fused front end: one streaming pass over the BGR rows writes the (B+G+R)/3
+// gray plane and accumulates its histogram while the row is still in cache.
+// Bands of rows run in parallel, each with its own histogram. hist may be null.
+void grayscaleHistogramClearText(const Mat& src, Mat& gray, int hist[256]) {
+    TRACE_SCOPE_CLEARTEXT("grayscale");
+    TRACE_COUNTER_CLEARTEXT("pixels", src.total());
+    CV_Assert(src.type() == CV_8UC3);
+
+    gray.create(src.rows, src.cols, CV_8UC1);
+
+    const KernelSetClearText& kernels = *g_kernelsClearText;
+    if (hist != nullptr) {
+        fill(hist, hist + 256, 0);
+    }
+    mutex histMutex;
+
+    parallelForClearText(Range(0, src.rows), [&](const Range& range) {
+        int partial[4][256] = { { 0 } };
+        for (int i = range.start; i < range.end; i++) {
+            uchar* grayRow = gray.ptr<uchar>(i);
+            kernels.grayRow(src.ptr<uchar>(i), grayRow, src.cols);
+
+            if (hist == nullptr) {
+                continue;
+            }
+
+            int j = 0;
+            for (; j <= src.cols - 4; j += 4) {
+                partial[0][grayRow[j]]++;
+                partial[1][grayRow[j + 1]]++;
+                partial[2][grayRow[j + 2]]++;
+                partial[3][grayRow[j + 3]]++;
+            }
+            for (; j < src.cols; j++) {
+                partial[0][grayRow[j]]++;
+            }
+        }
+
+        if (hist == nullptr) {
+            return;
+        }
+        lock_guard<mutex> lock(histMutex);
+        for (int v = 0; v < 256; v++) {
+            hist[v] += partial[0][v] + partial[1][v] + partial[2][v] + partial[3][v];
+        }
+    });
+}
+
+void thresholdBinaryClearText(const Mat& gray, Mat& dst, int T) {
+    CV_Assert(gray.type() == CV_8UC1);
+
+    dst.create(gray.rows, gray.cols, CV_8UC1);
+    uchar t = (uchar)max(0, min(255, T));
+    const KernelSetClearText& kernels = *g_kernelsClearText;
+
+    parallelForClearText(Range(0, gray.rows), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            kernels.thresholdRow(gray.ptr<uchar>(i), dst.ptr<uchar>(i), gray.cols, t);
+        }
+    });
+}
+
+// StructSize > 0 fixes the square at compile time so the kernel loops unroll;
+// StructSize == 0 is the generic version for any runtime structSize.
+template <int StructSize>
+Mat dilateSquareClearText(const Mat& src, int structSize) {
+    const int size = StructSize > 0 ? StructSize : structSize;
+    const int half = size / 2;
+    Mat dst = src.clone();
+
+    for (int i = half; i < src.rows - half; i++) {
+        const uchar* srcRow = src.ptr<uchar>(i);
+        for (int j = half; j < src.cols - half; j++) {
+            if (srcRow[j] == 0) {
+                for (int di = -half; di <= half; di++) {
+                    uchar* dstRow = dst.ptr<uchar>(i + di) + j;
+                    for (int dj = -half; dj <= half; dj++) {
+                        dstRow[dj] = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    return dst;
+}
+
+Mat dilateCustomClearText(Mat src, int structSize = 5) {
+    switch (structSize) {
+    case 3:
+        return dilateSquareClearText<3>(src, structSize);
+    case 5:
+        return dilateSquareClearText<5>(src, structSize);
+    case 7:
+        return dilateSquareClearText<7>(src, structSize);
+    default:
+        return dilateSquareClearText<0>(src, structSize);
+    }
+}
+
+enum class BinarizationModeClearText {
+    GlobalIterative,
+    Sauvola,
+    Niblack
+};
+
+// Local threshold per pixel from the mean m and standard deviation s of a
+// windowSize x windowSize neighborhood (clipped at the image border):
+// Sauvola T = m * (1 + k * (s / 128 - 1)), Niblack T = m + k * s.
+// m and s come in O(1) from integral images of gray and gray^2. Bands of rows
+// are processed in parallel, each with its own integral over the band plus
+// windowSize / 2 rows of halo, so memory stays proportional to the band.
+void adaptiveBinarizeClearText(const Mat& gray, Mat& dst, BinarizationModeClearText mode, int windowSize, double k) {
+    CV_Assert(gray.type() == CV_8UC1);
+
+    dst.create(gray.rows, gray.cols, CV_8UC1);
+    int rows = gray.rows;
+    int cols = gray.cols;
+    int half = max(1, windowSize / 2);
+    const int bandRows = 64;
+    int numBands = (rows + bandRows - 1) / bandRows;
+
+    parallelForClearText(Range(0, numBands), [&](const Range& range) {
+        vector<int64> sum, sqsum;
+        int stride = cols + 1;
+
+        for (int b = range.start; b < range.end; b++) {
+            int y0 = b * bandRows;
+            int y1 = min(rows, y0 + bandRows);
+            int top = max(0, y0 - half);
+            int bottom = min(rows, y1 + half);
+            int h = bottom - top;
+
+            sum.assign((size_t)(h + 1) * stride, 0);
+            sqsum.assign((size_t)(h + 1) * stride, 0);
+            for (int i = 0; i < h; i++) {
+                const uchar* grayRow = gray.ptr<uchar>(top + i);
+                const int64* sumAbove = &sum[(size_t)i * stride];
+                const int64* sqsumAbove = &sqsum[(size_t)i * stride];
+                int64* sumRow = &sum[(size_t)(i + 1) * stride];
+                int64* sqsumRow = &sqsum[(size_t)(i + 1) * stride];
+                int64 rowSum = 0, rowSqsum = 0;
+                for (int j = 0; j < cols; j++) {
+                    rowSum += grayRow[j];
+                    rowSqsum += grayRow[j] * grayRow[j];
+                    sumRow[j + 1] = sumAbove[j + 1] + rowSum;
+                    sqsumRow[j + 1] = sqsumAbove[j + 1] + rowSqsum;
+                }
+            }
+
+            for (int y = y0; y < y1; y++) {
+                const uchar* grayRow = gray.ptr<uchar>(y);
+                uchar* dstRow = dst.ptr<uchar>(y);
+                size_t r0 = (size_t)(max(0, y - half) - top) * stride;
+                size_t r1 = (size_t)(min(rows, y + half + 1) - top) * stride;
+                int windowRows = (int)((r1 - r0) / stride);
+
+                for (int x = 0; x < cols; x++) {
+                    int c0 = max(0, x - half);
+                    int c1 = min(cols, x + half + 1);
+                    double area = (double)windowRows * (c1 - c0);
+
+                    double s = (double)(sum[r1 + c1] - sum[r0 + c1] - sum[r1 + c0] + sum[r0 + c0]);
+                    double sq = (double)(sqsum[r1 + c1] - sqsum[r0 + c1] - sqsum[r1 + c0] + sqsum[r0 + c0]);
+                    double mean = s / area;
+                    double stddev = sqrt(max(0.0, sq / area - mean * mean));
+
+                    double T;
+                    if (mode == BinarizationModeClearText::Sauvola) {
+                        T = mean * (1 + k * (stddev / 128 - 1));
+                    }
+                    else {
+                        T = mean + k * stddev;
+                    }
+                    dstRow[x] = grayRow[x] < T ? 0 : 255;
+                }
+            }
+        }
+    });
+}
+
+template <bool TakeMin>
+inline uchar extremumClearText(uchar a, uchar b) {
+    return TakeMin ? min(a, b) : max(a, b);
+}
+
+// van Herk/Gil-Werman running min/max over a window of k samples centered like
+// OpenCV's default anchor: block-wise prefix (g) and suffix (h) extrema give
+// every window in 3 comparisons per sample, independent of k.
+template <bool TakeMin>
+void runningExtremumRowClearText(const uchar* src, uchar* dst, int n, int k, vector<uchar>& g, vector<uchar>& h) {
+    const uchar identity = TakeMin ? 255 : 0;
+    int before = k / 2;
+    int numBlocks = (n + 2 * k - 2) / k;
+
+    g.resize(numBlocks * k);
+    h.resize(numBlocks * k);
+
+    for (int b = 0; b < numBlocks; b++) {
+        int start = b * k;
+        for (int p = start; p < start + k; p++) {
+            int x = p - before;
+            uchar v = (x >= 0 && x < n) ? src[x] : identity;
+            g[p] = p == start ? v : extremumClearText<TakeMin>(g[p - 1], v);
+            h[p] = v;
+        }
+        for (int p = start + k - 2; p >= start; p--) {
+            h[p] = extremumClearText<TakeMin>(h[p], h[p + 1]);
+        }
+    }
+
+    for (int x = 0; x < n; x++) {
+        dst[x] = extremumClearText<TakeMin>(h[x], g[x + k - 1]);
+    }
+}
+
+// Same recurrence along the columns, computed one block of k rows at a time so
+// the whole row is processed at once and only 3 blocks of rows are buffered.
+// Each output row is written after every input row it depends on was read, so
+// the image is updated in place.
+template <bool TakeMin>
+void runningExtremumColumnsClearText(Mat& img, int k) {
+    const uchar identity = TakeMin ? 255 : 0;
+    const auto extremumRows = TakeMin ? g_kernelsClearText->minRows : g_kernelsClearText->maxRows;
+    int rows = img.rows;
+    int cols = img.cols;
+    int before = k / 2;
+    int numBlocks = (rows + 2 * k - 2) / k;
+
+    Mat gCur(k, cols, CV_8UC1);
+    Mat hCur(k, cols, CV_8UC1);
+    Mat hPrev(k, cols, CV_8UC1);
+
+    for (int b = 0; b <= numBlocks; b++) {
+        for (int t = 0; t < k; t++) {
+            int y = b * k + t - before;
+            uchar* hRow = hCur.ptr<uchar>(t);
+            if (b < numBlocks && y >= 0 && y < rows) {
+                memcpy(hRow, img.ptr<uchar>(y), cols);
+            }
+            else {
+                memset(hRow, identity, cols);
+            }
+
+            uchar* gRow = gCur.ptr<uchar>(t);
+            if (t == 0) {
+                memcpy(gRow, hRow, cols);
+            }
+            else {
+                extremumRows(gCur.ptr<uchar>(t - 1), hRow, gRow, cols);
+            }
+        }
+        for (int t = k - 2; t >= 0; t--) {
+            uchar* hRow = hCur.ptr<uchar>(t);
+            extremumRows(hRow, hCur.ptr<uchar>(t + 1), hRow, cols);
+        }
+
+        if (b > 0) {
+            for (int t = 0; t < k; t++) {
+                int y = (b - 1) * k + t;
+                if (y >= rows) {
+                    break;
+                }
+                uchar* outRow = img.ptr<uchar>(y);
+                const uchar* hRow = hPrev.ptr<uchar>(t);
+                if (t == 0) {
+                    memcpy(outRow, hRow, cols);
+                }
+                else {
+                    extremumRows(hRow, gCur.ptr<uchar>(t - 1), outRow, cols);
+                }
+            }
+        }
+
+        swap(hPrev, hCur);
+    }
+}
+
+template <bool TakeMin>
+void morphRectClearText(const Mat& src, Mat& dst, Size kernel) {
+    CV_Assert(src.type() == CV_8UC1 && kernel.width >= 1 && kernel.height >= 1);
+
+    dst.create(src.rows, src.cols, CV_8UC1);
+
+    if (kernel.width > 1) {
+        vector<uchar> line(src.cols), g, h;
+        for (int i = 0; i < src.rows; i++) {
+            memcpy(line.data(), src.ptr<uchar>(i), src.cols);
+            runningExtremumRowClearText<TakeMin>(line.data(), dst.ptr<uchar>(i), src.cols, kernel.width, g, h);
+        }
+    }
+    else if (dst.data != src.data) {
+        src.copyTo(dst);
+    }
+
+    if (kernel.height > 1) {
+        runningExtremumColumnsClearText<TakeMin>(dst, kernel.height);
+    }
+}
+
+// Dilation/erosion of the black (0) foreground with a kernel.width x kernel.height
+// rectangle. dst may be the same Mat as src.
+void dilateRectClearText(const Mat& src, Mat& dst, Size kernel) {
+    TRACE_SCOPE_CLEARTEXT("dilation");
+    morphRectClearText<true>(src, dst, kernel);
+}
+
+void erodeRectClearText(const Mat& src, Mat& dst, Size kernel) {
+    morphRectClearText<false>(src, dst, kernel);
+}
+
+// Binary image with 1 bit per pixel: bit j % 64 of word j / 64 of a row is set
+// for a black (text) pixel j, the packing of the sidecar files. The words live in
+// a Mat (8 bytes per word) so a scratch pool can provide them; bits past cols
+// are kept 0.
+struct BitplaneClearText {
+    int cols = 0;
+    int wordsPerRow = 0;
+    Mat words;
+
+    static Size storageSize(Size imageSize) {
+        return Size((imageSize.width + 63) / 64 * (int)sizeof(uint64), imageSize.height);
+    }
+
+    void create(int rows, int width) {
+        cols = width;
+        wordsPerRow = (width + 63) / 64;
+        words.create(storageSize(Size(width, rows)), CV_8UC1);
+    }
+
+    void clear() {
+        words.setTo(0);
+    }
+
+    int rows() const { return words.rows; }
+    Size size() const { return Size(cols, words.rows); }
+    uint64* row(int i) { return words.ptr<uint64>(i); }
+    const uint64* row(int i) const { return words.ptr<uint64>(i); }
+
+    bool test(int i, int j) const {
+        return (row(i)[j >> 6] >> (j & 63)) & 1;
+    }
+
+    uint64 lastWordMask() const {
+        return (cols & 63) == 0 ? ~(uint64)0 : ((uint64)1 << (cols & 63)) - 1;
+    }
+
+    // Number of black pixels, by popcount.
+    int64 count() const {
+        int64 total = 0;
+        for (int i = 0; i < rows(); i++) {
+            total += hal::normHamming(words.ptr<uchar>(i), wordsPerRow * (int)sizeof(uint64));
+        }
+        return total;
+    }
+
+    void complement() {
+        uint64 lastMask = lastWordMask();
+        for (int i = 0; i < rows(); i++) {
+            uint64* r = row(i);
+            for (int w = 0; w < wordsPerRow; w++) {
+                r[w] = ~r[w];
+            }
+            r[wordsPerRow - 1] &= lastMask;
+        }
+    }
+};
+
+// 0/255 row to bits (black = 1; any value below 128 counts as black).
+void packBinaryRowClearText(const uchar* src, int cols, uint64* words) {
+    g_kernelsClearText->packRow(src, cols, words);
+}
+
+// Bits to a 0/255 row, 8 pixels per table lookup.
+void unpackBinaryRowClearText(const uint64* words, int cols, uchar* dst) {
+    static const auto pixelsOfByte = []() {
+        vector<array<uchar, 8>> table(256);
+        for (int b = 0; b < 256; b++) {
+            for (int k = 0; k < 8; k++) {
+                table[b][k] = (b >> k) & 1 ? 0 : 255;
+            }
+        }
+        return table;
+    }();
+
+    int j = 0;
+    for (; j + 8 <= cols; j += 8) {
+        memcpy(dst + j, pixelsOfByte[(words[j >> 6] >> (j & 63)) & 0xFF].data(), 8);
+    }
+    for (; j < cols; j++) {
+        dst[j] = (words[j >> 6] >> (j & 63)) & 1 ? 0 : 255;
+    }
+}
+
+void packBinaryClearText(const Mat& binary, BitplaneClearText& bits) {
+    CV_Assert(binary.type() == CV_8UC1);
+    bits.create(binary.rows, binary.cols);
+    for (int i = 0; i < binary.rows; i++) {
+        packBinaryRowClearText(binary.ptr<uchar>(i), binary.cols, bits.row(i));
+    }
+}
+
+void unpackBinaryClearText(const BitplaneClearText& bits, Mat& binary) {
+    binary.create(bits.rows(), bits.cols, CV_8UC1);
+    for (int i = 0; i < binary.rows; i++) {
+        unpackBinaryRowClearText(bits.row(i), bits.cols, binary.ptr<uchar>(i));
+    }
+}
+
+// r[w] |= row r shifted toward its start by step pixels (bit j gets bit j + step),
+// in place from the first word on; the range tests are hoisted out of the loop.
+inline void orShiftedTowardStartClearText(uint64* r, int numWords, int step) {
+    int q = step >> 6, s = step & 63;
+    int w = 0;
+    if (s == 0) {
+        for (; w + q < numWords; w++) {
+            r[w] |= r[w + q];
+        }
+        return;
+    }
+    for (; w + q + 1 < numWords; w++) {
+        r[w] |= (r[w + q] >> s) | (r[w + q + 1] << (64 - s));
+    }
+    if (w + q < numWords) {
+        r[w] |= r[w + q] >> s;
+    }
+}
+
+// Same toward the end of the row (bit j gets bit j - step), from the last word back.
+inline void orShiftedTowardEndClearText(uint64* r, int numWords, int step) {
+    int q = step >> 6, s = step & 63;
+    int w = numWords - 1;
+    if (s == 0) {
+        for (; w - q >= 0; w--) {
+            r[w] |= r[w - q];
+        }
+        return;
+    }
+    for (; w - q - 1 >= 0; w--) {
+        r[w] |= (r[w - q] << s) | (r[w - q - 1] >> (64 - s));
+    }
+    if (w - q >= 0) {
+        r[w] |= r[w - q] << s;
+    }
+}
+
+// Dilation of the set bits with a kernel.width x kernel.height rectangle, with
+// the anchor of dilateRectClearText: pixel j gets the OR of [j - k / 2, j + k - 1 - k / 2].
+// The window is built in place by doubling: OR-ing with a copy shifted by
+// 1, 2, 4, ... pixels first toward the end of the row (covering the pixels after
+// j), then toward its start (the pixels before j), i.e. about 2 log2(k)
+// shift-OR passes over the words. Columns get the same treatment with whole
+// rows, shifted by row index. Rows are independent in the first pass and word
+// columns in the second, so the two passes split into parallel bands of rows
+// and of words. KernelWidth/KernelHeight > 0 fix the kernel at compile time, so
+// the doubling steps and shift amounts become constants; 0 takes them from kernel.
+template <int KernelWidth, int KernelHeight>
+void dilateBitsKernelClearText(BitplaneClearText& bits, Size kernel) {
+    const int kernelWidth = KernelWidth > 0 ? KernelWidth : kernel.width;
+    const int kernelHeight = KernelHeight > 0 ? KernelHeight : kernel.height;
+    int rows = bits.rows();
+    int numWords = bits.wordsPerRow;
+    uint64 lastMask = bits.lastWordMask();
+
+    if (kernelWidth > 1) {
+        const int before = kernelWidth / 2;
+        const int after = kernelWidth - 1 - before;
+        parallelForClearText(Range(0, rows), [&](const Range& range) {
+            for (int i = range.start; i < range.end; i++) {
+                uint64* r = bits.row(i);
+                for (int covered = 1; covered <= after; ) {
+                    int step = min(covered, after + 1 - covered);
+                    orShiftedTowardStartClearText(r, numWords, step);
+                    covered += step;
+                }
+                for (int covered = 1; covered <= before; ) {
+                    int step = min(covered, before + 1 - covered);
+                    orShiftedTowardEndClearText(r, numWords, step);
+                    covered += step;
+                }
+                r[numWords - 1] &= lastMask;
+            }
+        });
+    }
+
+    if (kernelHeight > 1) {
+        const auto orWords = g_kernelsClearText->orWords;
+        const int before = kernelHeight / 2;
+        const int after = kernelHeight - 1 - before;
+        // At least 8 words (a cache line) per column band.
+        int numColumnBands = max(1, min(taskPoolClearText().size(), numWords / 8));
+        parallelForClearText(Range(0, numWords), [&](const Range& words) {
+            int w0 = words.start;
+            int n = words.end - words.start;
+            for (int covered = 1; covered <= after; ) {
+                int step = min(covered, after + 1 - covered);
+                for (int i = 0; i + step < rows; i++) {
+                    orWords(bits.row(i) + w0, bits.row(i + step) + w0, n);
+                }
+                covered += step;
+            }
+            for (int covered = 1; covered <= before; ) {
+                int step = min(covered, before + 1 - covered);
+                for (int i = rows - 1; i - step >= 0; i--) {
+                    orWords(bits.row(i) + w0, bits.row(i - step) + w0, n);
+                }
+                covered += step;
+            }
+        }, numColumnBands);
+    }
+}
+
+// Picks the instantiation for the kernels the pipeline uses most: the default
+// block kernel (dilationSize 5, horizontalExtension 10) and the small squares.
+void dilateBitsClearText(BitplaneClearText& bits, Size kernel) {
+    TRACE_SCOPE_CLEARTEXT("dilation");
+    if (kernel == Size(25, 5)) {
+        dilateBitsKernelClearText<25, 5>(bits, kernel);
+    }
+    else if (kernel == Size(3, 3)) {
+        dilateBitsKernelClearText<3, 3>(bits, kernel);
+    }
+    else if (kernel == Size(5, 5)) {
+        dilateBitsKernelClearText<5, 5>(bits, kernel);
+    }
+    else {
+        dilateBitsKernelClearText<0, 0>(bits, kernel);
+    }
+}
+
+// Neighbor offsets for 4- or 8-connectivity, clockwise from the pixel above.
+// Both are compile-time constants, so loops over them unroll and need no
+// center test.
+template <int Connectivity>
+struct NeighborhoodClearText {
+    static_assert(Connectivity == 4 || Connectivity == 8, "4- or 8-connectivity");
+    static constexpr int size = Connectivity;
+
+    static constexpr int di(int k) {
+        return Connectivity == 8 ? (k == 0 || k == 1 || k == 7 ? -1 : k >= 3 && k <= 5 ? 1 : 0)
+            : (k == 0 ? -1 : k == 2 ? 1 : 0);
+    }
+
+    static constexpr int dj(int k) {
+        return Connectivity == 8 ? (k >= 1 && k <= 3 ? 1 : k >= 5 ? -1 : 0)
+            : (k == 1 ? 1 : k == 3 ? -1 : 0);
+    }
+};
+
+template <int Connectivity>
+int labelConnectedComponentsBfsClearText(const Mat& img, Mat& labels, vector<Rect>& boundingBoxes) {
+    typedef NeighborhoodClearText<Connectivity> Neighborhood;
+    int height = img.rows;
+    int width = img.cols;
+    int nr = 0;
+
+    labels = Mat::zeros(height, width, CV_32SC1);
+    boundingBoxes.clear();
+
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            if (img.at<uchar>(i, j) == 0 && labels.at<int>(i, j) == 0) {
+                nr++;
+                queue<Point> Q;
+                labels.at<int>(i, j) = nr;
+                Q.push(Point(j, i));
+
+                int minX = j, maxX = j, minY = i, maxY = i;
+
+                while (!Q.empty()) {
+                    Point q = Q.front();
+                    Q.pop();
+                    int qi = q.y;
+                    int qj = q.x;
+
+                    if (qj < minX) minX = qj;
+                    if (qj > maxX) maxX = qj;
+                    if (qi < minY) minY = qi;
+                    if (qi > maxY) maxY = qi;
+
+                    for (int k = 0; k < Neighborhood::size; k++) {
+                        int ni = qi + Neighborhood::di(k);
+                        int nj = qj + Neighborhood::dj(k);
+
+                        if (ni >= 0 && ni < height && nj >= 0 && nj < width) {
+                            if (img.at<uchar>(ni, nj) == 0 && labels.at<int>(ni, nj) == 0) {
+                                labels.at<int>(ni, nj) = nr;
+                                Q.push(Point(nj, ni));
+                            }
+                        }
+                    }
+                }
+
+                Rect bbox(minX, minY, maxX - minX + 1, maxY - minY + 1);
+                boundingBoxes.push_back(bbox);
+            }
+        }
+    }
+
+    return nr;
+}
+
+int labelConnectedComponentsClearText(Mat img, Mat& labels, vector<Rect>& boundingBoxes, int connectivity = 8) {
+    CV_Assert(connectivity == 4 || connectivity == 8);
+    return connectivity == 4 ? labelConnectedComponentsBfsClearText<4>(img, labels, boundingBoxes)
+        : labelConnectedComponentsBfsClearText<8>(img, labels, boundingBoxes);
+}
+
+struct ComponentStatsClearText {
+    Rect boundingBox;
+    int area;
+    Point2d centroid;
+};
+
+struct ComponentAccumulatorClearText {
+    int minX, minY, maxX, maxY;
+    int64 area, sumX, sumY;
+
+    ComponentAccumulatorClearText() : minX(INT_MAX), minY(INT_MAX), maxX(-1), maxY(-1), area(0), sumX(0), sumY(0) {}
+
+    void add(int x, int y) {
+        if (x < minX) minX = x;
+        if (x > maxX) maxX = x;
+        if (y < minY) minY = y;
+        if (y > maxY) maxY = y;
+        area++;
+        sumX += x;
+        sumY += y;
+    }
+
+    void merge(const ComponentAccumulatorClearText& other) {
+        minX = min(minX, other.minX);
+        maxX = max(maxX, other.maxX);
+        minY = min(minY, other.minY);
+        maxY = max(maxY, other.maxY);
+        area += other.area;
+        sumX += other.sumX;
+        sumY += other.sumY;
+    }
+
+    void shiftY(int dy) {
+        minY += dy;
+        maxY += dy;
+        sumY += area * dy;
+    }
+
+    Rect boundingBox() const {
+        return Rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+    }
+
+    ComponentStatsClearText stats() const {
+        ComponentStatsClearText s;
+        s.boundingBox = boundingBox();
+        s.area = (int)area;
+        s.centroid = Point2d((double)sumX / area, (double)sumY / area);
+        return s;
+    }
+};
+
+int findLabelRootClearText(vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+void unionLabelsClearText(vector<int>& parent, int a, int b) {
+    a = findLabelRootClearText(parent, a);
+    b = findLabelRootClearText(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    }
+    else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+// Merges the components of consecutive horizontal bands labeled on their own.
+// Bands are added top to bottom; pieces touching across a band border (with
+// the connectivity they were labeled with) are united, always keeping the
+// earlier piece as root, so resolve() returns the components in raster order
+// of their first pixel.
+struct ComponentStitcherClearText {
+    int connectivity = 8;
+    vector<int> parent;
+    vector<ComponentAccumulatorClearText> pieces;
+    vector<uchar> lastRow;
+    vector<int> lastIds;
+
+    int addBand(const Mat& img, const Mat& labels, const vector<ComponentAccumulatorClearText>& bandPieces) {
+        int base = (int)pieces.size();
+        int width = img.cols;
+
+        for (size_t p = 0; p < bandPieces.size(); p++) {
+            parent.push_back(base + (int)p);
+            pieces.push_back(bandPieces[p]);
+        }
+        if (img.rows == 0) {
+            return base;
+        }
+
+        if (!lastRow.empty()) {
+            const uchar* row = img.ptr<uchar>(0);
+            const int* labelRow = labels.ptr<int>(0);
+            int reach = connectivity == 8 ? 1 : 0;
+            for (int j = 0; j < width; j++) {
+                if (row[j] != 0) {
+                    continue;
+                }
+                int jStart = max(0, j - reach);
+                int jEnd = min(width - 1, j + reach);
+                for (int nj = jStart; nj <= jEnd; nj++) {
+                    if (lastRow[nj] == 0) {
+                        unionLabelsClearText(parent, base + labelRow[j] - 1, lastIds[nj]);
+                    }
+                }
+            }
+        }
+
+        const uchar* row = img.ptr<uchar>(img.rows - 1);
+        const int* labelRow = labels.ptr<int>(img.rows - 1);
+        lastRow.assign(row, row + width);
+        lastIds.resize(width);
+        for (int j = 0; j < width; j++) {
+            lastIds[j] = row[j] == 0 ? base + labelRow[j] - 1 : -1;
+        }
+
+        return base;
+    }
+
+    void resolve(vector<ComponentAccumulatorClearText>& components, vector<int>& finalLabel) {
+        components.clear();
+        finalLabel.resize(pieces.size());
+        for (int g = 0; g < (int)pieces.size(); g++) {
+            int root = findLabelRootClearText(parent, g);
+            if (root == g) {
+                finalLabel[g] = (int)components.size() + 1;
+                components.push_back(pieces[g]);
+            }
+            else {
+                finalLabel[g] = finalLabel[root];
+                components[finalLabel[g] - 1].merge(pieces[g]);
+            }
+        }
+    }
+};
+
+// First-pass label of the black pixel j: the label of its left neighbor or of
+// its neighbors in the previous row (j - 1 .. j + 1 for 8-connectivity, j only
+// for 4), merging the labels that meet there, or a new label. Bounded adds the
+// range tests needed in the first and last column only.
+template <int Connectivity, bool Bounded>
+inline int provisionalLabelClearText(const uchar* row, const uchar* prevRow, const int* labelRow,
+    const int* prevLabelRow, int j, int width, vector<int>& parent) {
+    const int reach = Connectivity == 8 ? 1 : 0;
+    int label = 0;
+    if ((!Bounded || j > 0) && row[j - 1] == 0) {
+        label = labelRow[j - 1];
+    }
+    if (prevRow != nullptr) {
+        for (int d = -reach; d <= reach; d++) {
+            int nj = j + d;
+            if (Bounded && (nj < 0 || nj >= width)) {
+                continue;
+            }
+            if (prevRow[nj] == 0) {
+                if (label == 0) {
+                    label = prevLabelRow[nj];
+                }
+                else if (prevLabelRow[nj] != label) {
+                    unionLabelsClearText(parent, label, prevLabelRow[nj]);
+                }
+            }
+        }
+    }
+    if (label == 0) {
+        label = (int)parent.size();
+        parent.push_back(label);
+    }
+    return label;
+}
+
+template <int Connectivity>
+void labelStripRowsClearText(const Mat& img, Mat& labels, int r0, int r1, vector<int>& parent) {
+    int width = img.cols;
+    for (int i = r0; i < r1; i++) {
+        const uchar* row = img.ptr<uchar>(i);
+        const uchar* prevRow = i > r0 ? img.ptr<uchar>(i - 1) : nullptr;
+        int* labelRow = labels.ptr<int>(i);
+        const int* prevLabelRow = i > r0 ? labels.ptr<int>(i - 1) : nullptr;
+
+        for (int j = 0; j < width; j++) {
+            if (row[j] != 0) {
+                labelRow[j] = 0;
+            }
+            else if (j == 0 || j == width - 1) {
+                labelRow[j] = provisionalLabelClearText<Connectivity, true>(row, prevRow, labelRow, prevLabelRow,
+                    j, width, parent);
+            }
+            else {
+                labelRow[j] = provisionalLabelClearText<Connectivity, false>(row, prevRow, labelRow, prevLabelRow,
+                    j, width, parent);
+            }
+        }
+    }
+}
+
+// Two-pass union-find labeling (4- or 8-connectivity) of the black pixels, run on
+// horizontal strips in parallel and stitched along the strip borders. Labels
+// are numbered in raster order of each component's first pixel, so labels and
+// boxes match labelConnectedComponentsClearText exactly.
+int labelComponentsAccumulateClearText(const Mat& img, Mat& labels, vector<ComponentAccumulatorClearText>& components,
+    int numStrips = 0, int connectivity = 8) {
+    TRACE_SCOPE_CLEARTEXT("labeling");
+    CV_Assert(connectivity == 4 || connectivity == 8);
+    int height = img.rows;
+    int width = img.cols;
+
+    labels.create(height, width, CV_32SC1);
+    components.clear();
+    if (height == 0 || width == 0) {
+        return 0;
+    }
+
+    if (numStrips <= 0) {
+        numStrips = taskPoolClearText().size();
+    }
+    numStrips = max(1, min(numStrips, height / 32));
+
+    vector<int> stripStart(numStrips + 1);
+    for (int s = 0; s <= numStrips; s++) {
+        stripStart[s] = (int)((int64)height * s / numStrips);
+    }
+
+    vector<vector<ComponentAccumulatorClearText>> stripPieces(numStrips);
+
+    parallelForClearText(Range(0, numStrips), [&](const Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            int r0 = stripStart[s];
+            int r1 = stripStart[s + 1];
+            vector<int> parent(1, 0);
+
+            if (connectivity == 4) {
+                labelStripRowsClearText<4>(img, labels, r0, r1, parent);
+            }
+            else {
+                labelStripRowsClearText<8>(img, labels, r0, r1, parent);
+            }
+
+            vector<int> compact(parent.size(), 0);
+            int numPieces = 0;
+            for (int l = 1; l < (int)parent.size(); l++) {
+                int root = findLabelRootClearText(parent, l);
+                compact[l] = root == l ? ++numPieces : compact[root];
+            }
+
+            vector<ComponentAccumulatorClearText>& pieces = stripPieces[s];
+            pieces.assign(numPieces, ComponentAccumulatorClearText());
+            for (int i = r0; i < r1; i++) {
+                int* labelRow = labels.ptr<int>(i);
+                for (int j = 0; j < width; j++) {
+                    if (labelRow[j] != 0) {
+                        labelRow[j] = compact[labelRow[j]];
+                        pieces[labelRow[j] - 1].add(j, i);
+                    }
+                }
+            }
+        }
+    });
+
+    ComponentStitcherClearText stitcher;
+    stitcher.connectivity = connectivity;
+    vector<int> base(numStrips);
+    for (int s = 0; s < numStrips; s++) {
+        base[s] = stitcher.addBand(img.rowRange(stripStart[s], stripStart[s + 1]),
+            labels.rowRange(stripStart[s], stripStart[s + 1]), stripPieces[s]);
+    }
+
+    vector<int> finalLabel;
+    stitcher.resolve(components, finalLabel);
+
+    parallelForClearText(Range(0, numStrips), [&](const Range& range) {
+        for (int s = range.start; s < range.end; s++) {
+            for (int i = stripStart[s]; i < stripStart[s + 1]; i++) {
+                int* labelRow = labels.ptr<int>(i);
+                for (int j = 0; j < width; j++) {
+                    if (labelRow[j] != 0) {
+                        labelRow[j] = finalLabel[base[s] + labelRow[j] - 1];
+                    }
+                }
+            }
+        }
+    });
+
+    return (int)components.size();
+}
+
+int labelComponentsUnionFindClearText(const Mat& img, Mat& labels, vector<Rect>& boundingBoxes,
+    vector<ComponentStatsClearText>* stats = nullptr, int numStrips = 0, int connectivity = 8) {
+    vector<ComponentAccumulatorClearText> components;
+    int numComponents = labelComponentsAccumulateClearText(img, labels, components, numStrips, connectivity);
+
+    boundingBoxes.clear();
+    boundingBoxes.reserve(components.size());
+    if (stats != nullptr) {
+        stats->clear();
+    }
+    for (const auto& component : components) {
+        boundingBoxes.push_back(component.boundingBox());
+        if (stats != nullptr) {
+            stats->push_back(component.stats());
+        }
+    }
+
+    return numComponents;
+}
+
+// Index of the lowest set bit of a nonzero word.
+inline int lowestSetBitClearText(uint64 word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// First column >= j whose bit equals `set`, or cols. Bits past cols are clear.
+inline int nextBitClearText(const uint64* row, int numWords, int cols, int j, bool set) {
+    int w = j >> 6;
+    if (w >= numWords) {
+        return cols;
+    }
+    uint64 flip = set ? 0 : ~(uint64)0;
+    uint64 word = (row[w] ^ flip) & (~(uint64)0 << (j & 63));
+    while (word == 0) {
+        if (++w >= numWords) {
+            return cols;
+        }
+        word = row[w] ^ flip;
+    }
+    return min(cols, (w << 6) + lowestSetBitClearText(word));
+}
+
+// Bounding boxes of the connected components of the set bits, labeled run by
+// run straight from the words: each row's runs of set bits are united with the
+// runs of the row above they touch, so no byte image or label image is needed.
+// Boxes come in raster order of each component's first pixel, like
+// labelComponentsUnionFindClearText.
+void labelBitplaneBoxesClearText(const BitplaneClearText& bits, int connectivity, vector<Rect>& boxes) {
+    struct RunClearText {
+        int row, start, end;
+    };
+    vector<RunClearText> runs;
+    vector<int> parent;
+    int cols = bits.cols;
+    int numWords = bits.wordsPerRow;
+    // 8-connectivity also joins runs that only touch diagonally.
+    int reach = connectivity == 8 ? 1 : 0;
+
+    size_t previousBegin = 0, previousEnd = 0;
+    for (int i = 0; i < bits.rows(); i++) {
+        const uint64* row = bits.row(i);
+        size_t currentBegin = runs.size();
+        size_t above = previousBegin;
+        for (int j = nextBitClearText(row, numWords, cols, 0, true); j < cols;
+            j = nextBitClearText(row, numWords, cols, j, true)) {
+            int end = nextBitClearText(row, numWords, cols, j, false);
+            int label = (int)runs.size();
+            runs.push_back({ i, j, end });
+            parent.push_back(label);
+
+            while (above < previousEnd && runs[above].end + reach <= j) {
+                above++;
+            }
+            for (size_t k = above; k < previousEnd && runs[k].start < end + reach; k++) {
+                unionLabelsClearText(parent, label, (int)k);
+            }
+            j = end;
+        }
+        previousBegin = currentBegin;
+        previousEnd = runs.size();
+    }
+
+    boxes.clear();
+    vector<int> boxOfRoot(runs.size(), -1);
+    vector<Point> boxEnd;
+    for (size_t r = 0; r < runs.size(); r++) {
+        int root = findLabelRootClearText(parent, (int)r);
+        const RunClearText& run = runs[r];
+        if (boxOfRoot[root] < 0) {
+            boxOfRoot[root] = (int)boxes.size();
+            boxes.push_back(Rect(run.start, run.row, 0, 0));
+            boxEnd.push_back(Point(run.end, run.row + 1));
+        }
+        int b = boxOfRoot[root];
+        boxes[b].x = min(boxes[b].x, run.start);
+        boxEnd[b].x = max(boxEnd[b].x, run.end);
+        boxEnd[b].y = run.row + 1;
+    }
+    for (size_t b = 0; b < boxes.size(); b++) {
+        boxes[b].width = boxEnd[b].x - boxes[b].x;
+        boxes[b].height = boxEnd[b].y - boxes[b].y;
+    }
+}
+
+Mat simpleInpaintingClearText(Mat original, Mat mask) {
+    typedef NeighborhoodClearText<8> Neighborhood;
+    TRACE_SCOPE_CLEARTEXT("inpainting");
+    TRACE_COUNTER_CLEARTEXT("inpaint_iterations", 10);
+    Mat result = original.clone();
+    Mat temp;
+
+    for (int iter = 0; iter < 10; iter++) {
+        result.copyTo(temp);
+
+        for (int i = 1; i < mask.rows - 1; i++) {
+            for (int j = 1; j < mask.cols - 1; j++) {
+                if (mask.at<uchar>(i, j) == 0) {
+                    int count = 0;
+                    Vec3f sum(0, 0, 0);
+
+                    for (int k = 0; k < Neighborhood::size; k++) {
+                        int ni = i + Neighborhood::di(k);
+                        int nj = j + Neighborhood::dj(k);
+
+                        if (mask.at<uchar>(ni, nj) == 255) {
+                            Vec3b pixel = result.at<Vec3b>(ni, nj);
+                            sum[0] += pixel[0];
+                            sum[1] += pixel[1];
+                            sum[2] += pixel[2];
+                            count++;
+                        }
+                    }
+
+                    if (count > 0) {
+                        temp.at<Vec3b>(i, j) = Vec3b(
+                            (uchar)(sum[0] / count),
+                            (uchar)(sum[1] / count),
+                            (uchar)(sum[2] / count)
+                        );
+                    }
+                }
+            }
+        }
+        swap(result, temp);
+    }
+
+    return result;
+}
+
+enum class InpaintModeClearText {
+    Frontier,
+    BackgroundModel,
+    IterativeReference
+};
+
+static InpaintModeClearText g_inpaintModeClearText = InpaintModeClearText::Frontier;
+static size_t g_memoryBudgetClearText = 0;
+static bool g_useSidecarsClearText = false;
+static bool g_verifySidecarsClearText = false;
+static string g_transcriptDirClearText;
+
+// Groups the block rectangles (grown by margin) into disjoint regions so that
+// every masked pixel is owned by exactly one region.
+vector<Rect> inpaintRegionsClearText(const vector<TextBlockClearText>& blocks, Size imageSize, int margin) {
+    Rect imageRect(0, 0, imageSize.width, imageSize.height);
+    vector<Rect> regions;
+    for (const auto& block : blocks) {
+        Rect grown(block.boundingBox.x - margin, block.boundingBox.y - margin,
+            block.boundingBox.width + 2 * margin, block.boundingBox.height + 2 * margin);
+        grown &= imageRect;
+        if (!grown.empty()) {
+            regions.push_back(grown);
+        }
+    }
+
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        sort(regions.begin(), regions.end(), [](const Rect& a, const Rect& b) { return a.x < b.x; });
+
+        vector<Rect> next;
+        vector<bool> used(regions.size(), false);
+        for (size_t i = 0; i < regions.size(); i++) {
+            if (used[i]) {
+                continue;
+            }
+            Rect current = regions[i];
+            for (size_t k = i + 1; k < regions.size() && regions[k].x < current.x + current.width; k++) {
+                if (!used[k] && (current & regions[k]).area() > 0) {
+                    current |= regions[k];
+                    used[k] = true;
+                    merged = true;
+                }
+            }
+            next.push_back(current);
+        }
+        regions.swap(next);
+    }
+
+    return regions;
+}
+
+// Calls visit(ni, nj) for the 8-neighbors of (i, j) in a w x h region. Only
+// pixels on the region border need the range tests of Bounded; the others get
+// the unrolled, test-free loop.
+template <bool Bounded, typename Visit>
+inline void visitRegionNeighborsClearText(int i, int j, int w, int h, Visit& visit) {
+    typedef NeighborhoodClearText<8> Neighborhood;
+    for (int k = 0; k < Neighborhood::size; k++) {
+        int ni = i + Neighborhood::di(k);
+        int nj = j + Neighborhood::dj(k);
+        if (!Bounded || (ni >= 0 && ni < h && nj >= 0 && nj < w)) {
+            visit(ni, nj);
+        }
+    }
+}
+
+template <typename Visit>
+inline void forEachRegionNeighborClearText(int i, int j, int w, int h, Visit visit) {
+    if (i > 0 && i < h - 1 && j > 0 && j < w - 1) {
+        visitRegionNeighborsClearText<false>(i, j, w, h, visit);
+    }
+    else {
+        visitRegionNeighborsClearText<true>(i, j, w, h, visit);
+    }
+}
+
+// Fills the masked (0) pixels of one region in onion-peel order: each layer is
+// the set of masked pixels touching already known ones and is averaged from
+// those known 8-neighbors only. Every masked pixel is queued and filled once,
+// so the cost is proportional to the region and any stroke width is filled.
+// Image pixel (y, x) is masked when bit (y, x) - maskOrigin of mask is set.
+int inpaintRegionFrontierClearText(Mat& image, const BitplaneClearText& mask, Point maskOrigin, Rect roi) {
+    const uchar MASKED = 0, KNOWN = 1, QUEUED = 2;
+    int w = roi.width;
+    int h = roi.height;
+
+    vector<uchar> state(w * h);
+    for (int i = 0; i < h; i++) {
+        const uint64* maskRow = mask.row(roi.y - maskOrigin.y + i);
+        int x0 = roi.x - maskOrigin.x;
+        for (int j = 0; j < w; j++) {
+            state[i * w + j] = (maskRow[(x0 + j) >> 6] >> ((x0 + j) & 63)) & 1 ? MASKED : KNOWN;
+        }
+    }
+
+    vector<int> frontier, next;
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++) {
+            if (state[i * w + j] != MASKED) {
+                continue;
+            }
+            bool touchesKnown = false;
+            forEachRegionNeighborClearText(i, j, w, h, [&](int ni, int nj) {
+                touchesKnown |= state[ni * w + nj] == KNOWN;
+            });
+            if (touchesKnown) {
+                frontier.push_back(i * w + j);
+            }
+        }
+    }
+    for (int p : frontier) {
+        state[p] = QUEUED;
+    }
+
+    int layers = 0;
+    vector<Vec3b> values;
+    while (!frontier.empty()) {
+        layers++;
+        values.resize(frontier.size());
+
+        for (size_t k = 0; k < frontier.size(); k++) {
+            int i = frontier[k] / w;
+            int j = frontier[k] % w;
+            int count = 0;
+            int sum0 = 0, sum1 = 0, sum2 = 0;
+
+            forEachRegionNeighborClearText(i, j, w, h, [&](int ni, int nj) {
+                if (state[ni * w + nj] == KNOWN) {
+                    const Vec3b& pixel = image.ptr<Vec3b>(roi.y + ni)[roi.x + nj];
+                    sum0 += pixel[0];
+                    sum1 += pixel[1];
+                    sum2 += pixel[2];
+                    count++;
+                }
+            });
+            values[k] = Vec3b((uchar)(sum0 / count), (uchar)(sum1 / count), (uchar)(sum2 / count));
+        }
+
+        for (size_t k = 0; k < frontier.size(); k++) {
+            int i = frontier[k] / w;
+            int j = frontier[k] % w;
+            image.ptr<Vec3b>(roi.y + i)[roi.x + j] = values[k];
+            state[frontier[k]] = KNOWN;
+        }
+
+        next.clear();
+        for (int p : frontier) {
+            int i = p / w;
+            int j = p % w;
+            forEachRegionNeighborClearText(i, j, w, h, [&](int ni, int nj) {
+                if (state[ni * w + nj] == MASKED) {
+                    state[ni * w + nj] = QUEUED;
+                    next.push_back(ni * w + nj);
+                }
+            });
+        }
+        frontier.swap(next);
+    }
+
+    return layers;
+}
+
+// The merged regions are disjoint and a region only reads pixels inside it, so
+// they are filled in parallel, one task per region.
+void inpaintFrontierClearText(Mat& image, const BitplaneClearText& mask, const vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("inpainting");
+    vector<Rect> regions = inpaintRegionsClearText(blocks, image.size(), 2);
+    // Layers per region; the counter reports the deepest one, the number of
+    // passes the reference mode would have needed.
+    vector<int> layers(regions.size(), 0);
+    parallelForClearText(Range(0, (int)regions.size()), [&](const Range& range) {
+        for (int r = range.start; r < range.end; r++) {
+            layers[r] = inpaintRegionFrontierClearText(image, mask, Point(0, 0), regions[r]);
+        }
+    }, (int)regions.size());
+    TRACE_COUNTER_CLEARTEXT("inpaint_iterations", layers.empty() ? 0 : *max_element(layers.begin(), layers.end()));
+}
+
+// Cell size of the background model: 1/8 of the page, 1/16 from about 600 dpi
+// on, so a cell stays around the height of a text line.
+int backgroundModelFactorClearText(Size imageSize) {
+    return max(imageSize.width, imageSize.height) >= 6000 ? 16 : 8;
+}
+
+// Reconstruction from a coarse model of the paper instead of filling the text
+// pixel by pixel. Each factor x factor cell gets the mean color of its pixels
+// outside the mask grown by one pixel (so the anti-aliased rim of the letters
+// stays out of the means); cells without any are filled at the coarse level by
+// the onion-peel inpainting; then every masked pixel takes the bilinear
+// interpolation of the four cell means around it. The cost is one pass over
+// the page and one over the masked pixels.
+void inpaintBackgroundModelClearText(Mat& image, const BitplaneClearText& mask, int factor) {
+    TRACE_SCOPE_CLEARTEXT("inpainting");
+    int rows = image.rows;
+    int cols = image.cols;
+    int numWords = mask.wordsPerRow;
+    int coarseRows = (rows + factor - 1) / factor;
+    int coarseCols = (cols + factor - 1) / factor;
+
+    Mat coarse(coarseRows, coarseCols, CV_8UC3, Scalar(255, 255, 255));
+    BitplaneClearText holes;
+    holes.create(coarseRows, coarseCols);
+    holes.clear();
+
+    // Rows of cells are independent: one band of them per task.
+    parallelForClearText(Range(0, coarseRows), [&](const Range& range) {
+        vector<int> sums(coarseCols * 3), counts(coarseCols);
+        vector<uint64> vertical(numWords), excluded(numWords);
+        for (int cy = range.start; cy < range.end; cy++) {
+            fill(sums.begin(), sums.end(), 0);
+            fill(counts.begin(), counts.end(), 0);
+
+            for (int i = cy * factor; i < min(rows, (cy + 1) * factor); i++) {
+                const uint64* above = mask.row(max(0, i - 1));
+                const uint64* current = mask.row(i);
+                const uint64* below = mask.row(min(rows - 1, i + 1));
+                for (int w = 0; w < numWords; w++) {
+                    vertical[w] = above[w] | current[w] | below[w];
+                }
+                for (int w = 0; w < numWords; w++) {
+                    uint64 previous = w > 0 ? vertical[w - 1] >> 63 : 0;
+                    uint64 next = w + 1 < numWords ? vertical[w + 1] << 63 : 0;
+                    excluded[w] = vertical[w] | (vertical[w] << 1) | previous | (vertical[w] >> 1) | next;
+                }
+
+                const Vec3b* imageRow = image.ptr<Vec3b>(i);
+                for (int cx = 0; cx < coarseCols; cx++) {
+                    int* sum = &sums[cx * 3];
+                    for (int j = cx * factor; j < min(cols, (cx + 1) * factor); j++) {
+                        if (!((excluded[j >> 6] >> (j & 63)) & 1)) {
+                            sum[0] += imageRow[j][0];
+                            sum[1] += imageRow[j][1];
+                            sum[2] += imageRow[j][2];
+                            counts[cx]++;
+                        }
+                    }
+                }
+            }
+
+            Vec3b* coarseRow = coarse.ptr<Vec3b>(cy);
+            uint64* holeRow = holes.row(cy);
+            for (int cx = 0; cx < coarseCols; cx++) {
+                int n = counts[cx];
+                if (n == 0) {
+                    holeRow[cx >> 6] |= (uint64)1 << (cx & 63);
+                    continue;
+                }
+                coarseRow[cx] = Vec3b((uchar)((sums[cx * 3] + n / 2) / n), (uchar)((sums[cx * 3 + 1] + n / 2) / n),
+                    (uchar)((sums[cx * 3 + 2] + n / 2) / n));
+            }
+        }
+    });
+
+    TRACE_COUNTER_CLEARTEXT("masked_pixels", mask.count());
+    // No cell kept any paper outside the grown mask: there is no model to
+    // interpolate, so fill the page from whatever pixels are left unmasked.
+    if (holes.count() == (int64)coarseRows * coarseCols) {
+        inpaintRegionFrontierClearText(image, mask, Point(0, 0), Rect(0, 0, cols, rows));
+        return;
+    }
+    inpaintRegionFrontierClearText(coarse, holes, Point(0, 0), Rect(0, 0, coarseCols, coarseRows));
+
+    // Cell centers sit at (c + 0.5) * factor - 0.5; weights in 1/256.
+    auto interpolation = [factor](int n, int coarseN, vector<int>& first, vector<int>& weight) {
+        first.resize(n);
+        weight.resize(n);
+        for (int x = 0; x < n; x++) {
+            double f = (x + 0.5) / factor - 0.5;
+            int c = (int)floor(f);
+            int wgt = cvRound((f - c) * 256);
+            if (c < 0) {
+                c = 0;
+                wgt = 0;
+            }
+            else if (c >= coarseN - 1) {
+                c = coarseN - 1;
+                wgt = 0;
+            }
+            first[x] = c;
+            weight[x] = wgt;
+        }
+    };
+    vector<int> x0, wx, y0, wy;
+    interpolation(cols, coarseCols, x0, wx);
+    interpolation(rows, coarseRows, y0, wy);
+
+    parallelForClearText(Range(0, rows), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            const uint64* maskRow = mask.row(i);
+            const Vec3b* top = coarse.ptr<Vec3b>(y0[i]);
+            const Vec3b* bottom = coarse.ptr<Vec3b>(min(coarseRows - 1, y0[i] + 1));
+            int wb = wy[i];
+            Vec3b* imageRow = image.ptr<Vec3b>(i);
+            for (int w = 0; w < numWords; w++) {
+                uint64 word = maskRow[w];
+                for (int j = w * 64; word != 0; j++, word >>= 1) {
+                    if (!(word & 1)) {
+                        continue;
+                    }
+                    int xa = x0[j];
+                    int xb = min(coarseCols - 1, xa + 1);
+                    int wr = wx[j];
+                    for (int c = 0; c < 3; c++) {
+                        int upper = top[xa][c] * (256 - wr) + top[xb][c] * wr;
+                        int lower = bottom[xa][c] * (256 - wr) + bottom[xb][c] * wr;
+                        imageRow[j][c] = (uchar)((upper * (256 - wb) + lower * wb + (1 << 15)) >> 16);
+                    }
+                }
+            }
+        }
+    });
+}
+
+enum class BlockFormationModeClearText {
+    PixelDilation,
+    BoxClustering
+};
+
+struct DetectionParamsClearText {
+    int minComponentArea = 10;
+    int maxComponentArea = 5000;
+    int maxComponentWidthDiv = 4;
+    int maxComponentHeightDiv = 10;
+    int minComponentSide = 5;
+    int dilationSize = 5;
+    int horizontalExtension = 10;
+    int minBlockArea = 200;
+    int maxBlockAreaDiv = 8;
+    int minBlockWidth = 20;
+    int minBlockHeight = 10;
+    BinarizationModeClearText binarization = BinarizationModeClearText::GlobalIterative;
+    int adaptiveWindow = 31;
+    double sauvolaK = 0.2;
+    double niblackK = -0.2;
+    BlockFormationModeClearText blockFormation = BlockFormationModeClearText::PixelDilation;
+    int pyramidFactor = 1;
+    int connectivity = 8;
+};
+
+// Arena for the full-page intermediates of one worker. borrow() hands out a
+// header of the requested size on a pooled buffer; reset() at the end of a page
+// returns every buffer at once. Buffers only grow, so once the largest page
+// has been seen the pipeline stops allocating. Not thread-safe.
+struct ScratchPoolClearText {
+    struct BufferClearText {
+        Mat storage;
+        bool borrowed = false;
+    };
+
+    vector<unique_ptr<BufferClearText>> buffers;
+    size_t reservedBytes = 0;
+    size_t allocations = 0;
+
+    Mat borrow(Size size, int type) {
+        size_t bytes = (size_t)size.area() * CV_ELEM_SIZE(type);
+        BufferClearText* best = nullptr;
+        for (auto& buffer : buffers) {
+            if (buffer->borrowed) {
+                continue;
+            }
+            size_t capacity = buffer->storage.total();
+            size_t bestCapacity = best ? best->storage.total() : 0;
+            bool fits = capacity >= bytes;
+            bool bestFits = bestCapacity >= bytes;
+            // Smallest buffer that fits, otherwise the largest one to grow.
+            if (!best || (fits && (!bestFits || capacity < bestCapacity)) || (!fits && !bestFits && capacity > bestCapacity)) {
+                best = buffer.get();
+            }
+        }
+        if (!best) {
+            buffers.push_back(make_unique<BufferClearText>());
+            best = buffers.back().get();
+        }
+        if (best->storage.total() < bytes) {
+            size_t capacityBefore = best->storage.total();
+            const size_t rowBytes = 4096;
+            best->storage.create((int)((bytes + rowBytes - 1) / rowBytes), (int)rowBytes, CV_8UC1);
+            reservedBytes += best->storage.total() - capacityBefore;
+            allocations++;
+        }
+        best->borrowed = true;
+        return Mat(size, type, best->storage.data);
+    }
+
+    void reset() {
+        for (auto& buffer : buffers) {
+            buffer->borrowed = false;
+        }
+    }
+};
+
+struct MappedFileClearText;
+
+// A page restored from its sidecar has no byte binary: binaryBits then points at
+// the packed rows inside the mapped file, which sidecarFile keeps open, and
+// binaryBytesClearText unpacks them only when a window shows them.
+struct PageClearText {
+    Mat original;
+    Mat gray;
+    Mat binary;
+    Mat dilated;
+    vector<TextBlockClearText> blocks;
+    BitplaneClearText binaryBits;
+    shared_ptr<MappedFileClearText> sidecarFile;
+};
+
+const Mat& binaryBytesClearText(PageClearText& page) {
+    if (page.binary.empty() && !page.binaryBits.words.empty()) {
+        unpackBinaryClearText(page.binaryBits, page.binary);
+    }
+    return page.binary;
+}
+
+void grayscaleClearText(const Mat& src, Mat& dst) {
+    dst.create(src.rows, src.cols, CV_8UC1);
+
+    for (int i = 0; i < src.rows; i++) {
+        for (int j = 0; j < src.cols; j++) {
+            Vec3b pixel = src.at<Vec3b>(i, j);
+            uchar gray = (pixel[0] + pixel[1] + pixel[2]) / 3;
+            dst.at<uchar>(i, j) = gray;
+        }
+    }
+}
+
+bool isTextComponentClearText(const Rect& box, Size imageSize, const DetectionParamsClearText& params) {
+    int area = box.area();
+
+    return area > params.minComponentArea && area < params.maxComponentArea &&
+        box.width < imageSize.width / params.maxComponentWidthDiv &&
+        box.height < imageSize.height / params.maxComponentHeightDiv &&
+        box.width > params.minComponentSide && box.height > params.minComponentSide;
+}
+
+bool isTextBlockClearText(const Rect& box, Size imageSize, const DetectionParamsClearText& params) {
+    return box.area() > params.minBlockArea &&
+        box.area() < imageSize.width * imageSize.height / params.maxBlockAreaDiv &&
+        box.width > params.minBlockWidth && box.height > params.minBlockHeight;
+}
+
+void binarizeGrayClearText(const Mat& gray, const int hist[256], const DetectionParamsClearText& params, Mat& binary) {
+    TRACE_SCOPE_CLEARTEXT("threshold");
+    switch (params.binarization) {
+    case BinarizationModeClearText::Sauvola:
+        adaptiveBinarizeClearText(gray, binary, params.binarization, params.adaptiveWindow, params.sauvolaK);
+        break;
+    case BinarizationModeClearText::Niblack:
+        adaptiveBinarizeClearText(gray, binary, params.binarization, params.adaptiveWindow, params.niblackK);
+        break;
+    default:
+        thresholdBinaryClearText(gray, binary, computeAutoThresholdClearText(hist));
+        break;
+    }
+}
+
+// Binarizes only `region` of the color page, with the same result as that
+// region of a whole-page binarization. Local modes read window / 2 extra pixels
+// around the region; globalT is only used by the global mode.
+void binarizeRegionClearText(const Mat& original, Rect region, int globalT, const DetectionParamsClearText& params,
+    Mat& gray, Mat& binary) {
+    TRACE_SCOPE_CLEARTEXT("threshold");
+    if (params.binarization == BinarizationModeClearText::GlobalIterative) {
+        grayscaleHistogramClearText(original(region), gray, nullptr);
+        thresholdBinaryClearText(gray, binary, globalT);
+        return;
+    }
+
+    int half = max(1, params.adaptiveWindow / 2);
+    Rect extended(region.x - half, region.y - half, region.width + 2 * half, region.height + 2 * half);
+    extended &= Rect(0, 0, original.cols, original.rows);
+
+    Mat extendedBinary;
+    grayscaleHistogramClearText(original(extended), gray, nullptr);
+    double k = params.binarization == BinarizationModeClearText::Sauvola ? params.sauvolaK : params.niblackK;
+    adaptiveBinarizeClearText(gray, extendedBinary, params.binarization, params.adaptiveWindow, k);
+    extendedBinary(region - extended.tl()).copyTo(binary);
+}
+
+Size blockKernelClearText(const DetectionParamsClearText& params) {
+    return Size(params.dilationSize + 2 * params.horizontalExtension, params.dilationSize);
+}
+
+void paintTextComponentsClearText(const Mat& labels, const vector<Rect>& boundingBoxes, Size imageSize,
+    const DetectionParamsClearText& params, Mat& dst) {
+    TRACE_SCOPE_CLEARTEXT("component_filter");
+    vector<bool> isTextComponent(boundingBoxes.size() + 1, false);
+    for (size_t i = 0; i < boundingBoxes.size(); i++) {
+        if (isTextComponentClearText(boundingBoxes[i], imageSize, params)) {
+            isTextComponent[i + 1] = true;
+        }
+    }
+    TRACE_COUNTER_CLEARTEXT("components_kept", count(isTextComponent.begin(), isTextComponent.end(), true));
+
+    dst.create(labels.size(), CV_8UC1);
+    dst.setTo(255);
+
+    for (int i = 0; i < labels.rows; i++) {
+        const int* labelRow = labels.ptr<int>(i);
+        uchar* dstRow = dst.ptr<uchar>(i);
+        for (int j = 0; j < labels.cols; j++) {
+            int label = labelRow[j];
+            if (label > 0 && isTextComponent[label]) {
+                dstRow[j] = 0;
+            }
+        }
+    }
+}
+
+// Same selection as paintTextComponentsClearText, written straight to a
+// bitplane one 64-pixel word at a time.
+void paintTextComponentsBitsClearText(const Mat& labels, const vector<Rect>& boundingBoxes, Size imageSize,
+    const DetectionParamsClearText& params, BitplaneClearText& dst) {
+    TRACE_SCOPE_CLEARTEXT("component_filter");
+    vector<uchar> isTextComponent(boundingBoxes.size() + 1, 0);
+    for (size_t i = 0; i < boundingBoxes.size(); i++) {
+        isTextComponent[i + 1] = isTextComponentClearText(boundingBoxes[i], imageSize, params);
+    }
+    TRACE_COUNTER_CLEARTEXT("components_kept", count(isTextComponent.begin(), isTextComponent.end(), 1));
+
+    dst.create(labels.rows, labels.cols);
+    for (int i = 0; i < labels.rows; i++) {
+        const int* labelRow = labels.ptr<int>(i);
+        uint64* dstRow = dst.row(i);
+        for (int j = 0; j < labels.cols; j += 64) {
+            uint64 word = 0;
+            int end = min(labels.cols, j + 64);
+            for (int t = j; t < end; t++) {
+                word |= (uint64)isTextComponent[labelRow[t]] << (t & 63);
+            }
+            dstRow[j >> 6] = word;
+        }
+    }
+}
+
+void keepTextBlocksClearText(const vector<Rect>& candidates, Size imageSize, const DetectionParamsClearText& params,
+    vector<TextBlockClearText>& blocks) {
+    blocks.clear();
+    for (const Rect& candidate : candidates) {
+        if (isTextBlockClearText(candidate, imageSize, params)) {
+            blocks.push_back(TextBlockClearText(candidate, (int)blocks.size()));
+        }
+    }
+    TRACE_COUNTER_CLEARTEXT("blocks", blocks.size());
+}
+
+void extractTextBlocksClearText(const Mat& dilated, const DetectionParamsClearText& params, Mat& labels,
+    vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("block_extraction");
+    vector<Rect> finalBoundingBoxes;
+    labelComponentsUnionFindClearText(dilated, labels, finalBoundingBoxes, nullptr, 0, params.connectivity);
+    keepTextBlocksClearText(finalBoundingBoxes, dilated.size(), params, blocks);
+}
+
+// Same from the bit-packed dilation, labeled run by run.
+void extractTextBlocksBitsClearText(const BitplaneClearText& dilated, const DetectionParamsClearText& params,
+    vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("block_extraction");
+    vector<Rect> finalBoundingBoxes;
+    labelBitplaneBoxesClearText(dilated, params.connectivity, finalBoundingBoxes);
+    keepTextBlocksClearText(finalBoundingBoxes, dilated.size(), params, blocks);
+}
+
+// Block formation from the component boxes alone. Each text box is grown by the
+// amounts the block kernel dilates a pixel, and grown boxes that overlap or touch
+// (8-connectivity) are merged with union-find, neighbors coming from a grid.
+// Same result as dilation + second labeling except that gaps inside a box count
+// as ink; the cost depends on the number of components, not of pixels. The
+// clusters come out, before the block thresholds, in raster order of their first
+// pixel like the labeled blocks; that pixel is the top-left corner of the
+// topmost grown box, so the order can differ from the pixel path when the ink
+// in a box's top row starts right of the box's left edge.
+void clusterTextBoxesClearText(const vector<Rect>& textBoxes, Size imageSize, Size kernel, vector<Rect>& clusters) {
+    int right = kernel.width / 2;
+    int left = kernel.width - 1 - right;
+    int down = kernel.height / 2;
+    int up = kernel.height - 1 - down;
+    Rect imageRect(0, 0, imageSize.width, imageSize.height);
+
+    vector<Rect> grown;
+    grown.reserve(textBoxes.size());
+    for (const Rect& box : textBoxes) {
+        grown.push_back(Rect(box.x - left, box.y - up, box.width + left + right, box.height + up + down) & imageRect);
+    }
+
+    // One extra column and row on the far side turns "touching" into overlap.
+    RectGridIndexClearText grid;
+    grid.reset(imageRect, RectGridIndexClearText::suggestCellSize(imageSize, grown.size()));
+    for (size_t i = 0; i < grown.size(); i++) {
+        grid.insert((int)i, Rect(grown[i].x, grown[i].y, grown[i].width + 1, grown[i].height + 1));
+    }
+
+    vector<int> parent(grown.size());
+    for (size_t i = 0; i < grown.size(); i++) {
+        parent[i] = (int)i;
+    }
+    for (size_t i = 0; i < grown.size(); i++) {
+        grid.queryRect(grid.itemRects[i], [&](int j) {
+            if (j > (int)i) {
+                unionLabelsClearText(parent, (int)i, j);
+            }
+        });
+    }
+
+    vector<int> clusterOf(grown.size(), -1);
+    vector<Rect> merged;
+    vector<Point> firstPixel;
+    for (size_t i = 0; i < grown.size(); i++) {
+        int root = findLabelRootClearText(parent, (int)i);
+        Point corner = grown[i].tl();
+        if (clusterOf[root] < 0) {
+            clusterOf[root] = (int)merged.size();
+            merged.push_back(grown[i]);
+            firstPixel.push_back(corner);
+        }
+        else {
+            int c = clusterOf[root];
+            merged[c] |= grown[i];
+            if (corner.y < firstPixel[c].y || (corner.y == firstPixel[c].y && corner.x < firstPixel[c].x)) {
+                firstPixel[c] = corner;
+            }
+        }
+    }
+
+    vector<int> order(merged.size());
+    for (size_t c = 0; c < order.size(); c++) {
+        order[c] = (int)c;
+    }
+    sort(order.begin(), order.end(), [&](int a, int b) {
+        return firstPixel[a].y != firstPixel[b].y ? firstPixel[a].y < firstPixel[b].y : firstPixel[a].x < firstPixel[b].x;
+    });
+    clusters.clear();
+    for (int c : order) {
+        clusters.push_back(merged[c]);
+    }
+}
+
+void clusterTextBlocksClearText(const vector<Rect>& boundingBoxes, Size imageSize,
+    const DetectionParamsClearText& params, vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("block_clustering");
+    vector<Rect> textBoxes;
+    for (const Rect& box : boundingBoxes) {
+        if (isTextComponentClearText(box, imageSize, params)) {
+            textBoxes.push_back(box);
+        }
+    }
+    TRACE_COUNTER_CLEARTEXT("components_kept", textBoxes.size());
+
+    vector<Rect> clusters;
+    clusterTextBoxesClearText(textBoxes, imageSize, blockKernelClearText(params), clusters);
+    keepTextBlocksClearText(clusters, imageSize, params, blocks);
+}
+
+// Shrinks a binary image by `factor` in both directions. A coarse pixel is black
+// when at least half of its factor x factor cell is black, so strokes as thick as
+// half a cell survive while the few-pixel gaps between letters stay open.
+void downsampleBinaryClearText(const Mat& binary, Mat& dst, int factor) {
+    TRACE_SCOPE_CLEARTEXT("downsample");
+    int rows = (binary.rows + factor - 1) / factor;
+    int cols = (binary.cols + factor - 1) / factor;
+    dst.create(rows, cols, CV_8UC1);
+
+    vector<int> blackCount(cols);
+    for (int ci = 0; ci < rows; ci++) {
+        int rowBegin = ci * factor;
+        int rowEnd = min(binary.rows, rowBegin + factor);
+        fill(blackCount.begin(), blackCount.end(), 0);
+        for (int i = rowBegin; i < rowEnd; i++) {
+            const uchar* srcRow = binary.ptr<uchar>(i);
+            for (int j = 0; j < binary.cols; j++) {
+                blackCount[j / factor] += srcRow[j] == 0;
+            }
+        }
+
+        uchar* dstRow = dst.ptr<uchar>(ci);
+        for (int cj = 0; cj < cols; cj++) {
+            int cellArea = (rowEnd - rowBegin) * (min(binary.cols, (cj + 1) * factor) - cj * factor);
+            dstRow[cj] = 2 * blackCount[cj] >= cellArea ? 0 : 255;
+        }
+    }
+}
+
+// Detection parameters for an image downsampled by `factor`: areas shrink by
+// factor^2 and lengths by factor, rounding toward the more permissive side since
+// the final blocks are checked again at full resolution.
+DetectionParamsClearText scaledDetectionParamsClearText(const DetectionParamsClearText& params, int factor) {
+    DetectionParamsClearText scaled = params;
+    int areaFactor = factor * factor;
+    scaled.minComponentArea = params.minComponentArea / areaFactor;
+    scaled.maxComponentArea = (params.maxComponentArea + areaFactor - 1) / areaFactor;
+    scaled.minComponentSide = params.minComponentSide / factor;
+    // The kernel bridges gaps of up to size - 1 pixels, i.e. (size - 1) / factor cells.
+    Size kernel = blockKernelClearText(params);
+    scaled.dilationSize = (kernel.height - 1) / factor + 1;
+    scaled.horizontalExtension = ((kernel.width - 1) / factor + 1 - scaled.dilationSize) / 2;
+    scaled.minBlockArea = params.minBlockArea / areaFactor;
+    scaled.minBlockWidth = params.minBlockWidth / factor;
+    scaled.minBlockHeight = params.minBlockHeight / factor;
+    scaled.pyramidFactor = 1;
+    return scaled;
+}
+
+// Coarse-to-fine block formation. Labeling, component filtering and block
+// formation run on the binary image downsampled by params.pyramidFactor; each
+// coarse block is then refined at full resolution inside its own ROI: the box
+// is fitted tightly around the black pixels of its text cells and grown by the
+// block kernel, exactly as full-resolution dilation would grow it.
+void detectTextBlocksCoarseToFineClearText(const Mat& binary, const DetectionParamsClearText& params,
+    vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("coarse_to_fine");
+    int factor = params.pyramidFactor;
+    DetectionParamsClearText coarseParams = scaledDetectionParamsClearText(params, factor);
+
+    Mat coarse;
+    downsampleBinaryClearText(binary, coarse, factor);
+
+    Mat labels;
+    vector<Rect> boundingBoxes;
+    labelComponentsUnionFindClearText(coarse, labels, boundingBoxes, nullptr, 0, coarseParams.connectivity);
+    TRACE_COUNTER_CLEARTEXT("components_found", boundingBoxes.size());
+
+    Mat textCells;
+    paintTextComponentsClearText(labels, boundingBoxes, coarse.size(), coarseParams, textCells);
+
+    vector<TextBlockClearText> coarseBlocks;
+    if (params.blockFormation == BlockFormationModeClearText::BoxClustering) {
+        clusterTextBlocksClearText(boundingBoxes, coarse.size(), coarseParams, coarseBlocks);
+    }
+    else {
+        Mat dilated;
+        dilateRectClearText(textCells, dilated, blockKernelClearText(coarseParams));
+        extractTextBlocksClearText(dilated, coarseParams, labels, coarseBlocks);
+    }
+
+    // Cells next to a text cell may hold its edge pixels (less than half a cell).
+    TRACE_SCOPE_CLEARTEXT("refine");
+    dilateRectClearText(textCells, textCells, Size(3, 3));
+    Size coarseKernel = blockKernelClearText(coarseParams);
+    int coarseRight = coarseKernel.width / 2;
+    int coarseLeft = coarseKernel.width - 1 - coarseRight;
+    int coarseDown = coarseKernel.height / 2;
+    int coarseUp = coarseKernel.height - 1 - coarseDown;
+
+    Size kernel = blockKernelClearText(params);
+    int right = kernel.width / 2;
+    int left = kernel.width - 1 - right;
+    int down = kernel.height / 2;
+    int up = kernel.height - 1 - down;
+    Rect imageRect(0, 0, binary.cols, binary.rows);
+
+    blocks.clear();
+    for (const TextBlockClearText& coarseBlock : coarseBlocks) {
+        // Undo the coarse kernel growth, except on sides clipped by the image.
+        const Rect& box = coarseBlock.boundingBox;
+        int x0 = max(0, box.x > 0 ? box.x + coarseLeft - 1 : 0);
+        int y0 = max(0, box.y > 0 ? box.y + coarseUp - 1 : 0);
+        int x1 = min(coarse.cols, box.x + box.width < coarse.cols ? box.x + box.width - coarseRight + 1 : coarse.cols);
+        int y1 = min(coarse.rows, box.y + box.height < coarse.rows ? box.y + box.height - coarseDown + 1 : coarse.rows);
+
+        int minX = INT_MAX, minY = INT_MAX, maxX = -1, maxY = -1;
+        for (int ci = y0; ci < y1; ci++) {
+            const uchar* cellRow = textCells.ptr<uchar>(ci);
+            int rowEnd = min(binary.rows, (ci + 1) * factor);
+            for (int cj = x0; cj < x1; cj++) {
+                if (cellRow[cj] != 0) {
+                    continue;
+                }
+                int colEnd = min(binary.cols, (cj + 1) * factor);
+                for (int i = ci * factor; i < rowEnd; i++) {
+                    const uchar* binaryRow = binary.ptr<uchar>(i);
+                    for (int j = cj * factor; j < colEnd; j++) {
+                        if (binaryRow[j] == 0) {
+                            minX = min(minX, j);
+                            maxX = max(maxX, j);
+                            minY = min(minY, i);
+                            maxY = max(maxY, i);
+                        }
+                    }
+                }
+            }
+        }
+        if (maxX < 0) {
+            continue;
+        }
+
+        Rect refined = Rect(minX - left, minY - up, maxX - minX + 1 + left + right, maxY - minY + 1 + up + down) & imageRect;
+        if (isTextBlockClearText(refined, binary.size(), params)) {
+            blocks.push_back(TextBlockClearText(refined, (int)blocks.size()));
+        }
+    }
+    TRACE_COUNTER_CLEARTEXT("blocks", blocks.size());
+}
+
+// Everything after the first labeling pass: component filter and block
+// formation into page.blocks. The dilation stays bit-packed and its blocks are
+// labeled from the words; without a scratch pool (the interactive modes, which
+// show it) it is also unpacked into page.dilated.
+void formTextBlocksClearText(PageClearText& page, const Mat& componentLabels, const vector<Rect>& boundingBoxes,
+    const DetectionParamsClearText& params, ScratchPoolClearText* scratch = nullptr) {
+    if (params.blockFormation == BlockFormationModeClearText::BoxClustering) {
+        page.dilated.release();
+        clusterTextBlocksClearText(boundingBoxes, page.original.size(), params, page.blocks);
+        return;
+    }
+
+    BitplaneClearText textBits;
+    if (scratch != nullptr) {
+        textBits.words = scratch->borrow(BitplaneClearText::storageSize(page.original.size()), CV_8UC1);
+    }
+    paintTextComponentsBitsClearText(componentLabels, boundingBoxes, page.original.size(), params, textBits);
+    dilateBitsClearText(textBits, blockKernelClearText(params));
+    if (scratch == nullptr) {
+        unpackBinaryClearText(textBits, page.dilated);
+    }
+    else {
+        page.dilated.release();
+    }
+
+    extractTextBlocksBitsClearText(textBits, params, page.blocks);
+}
+
+// With a scratch pool, every intermediate (gray, binary, labels, bit-packed
+// dilation) lives in pooled buffers that stay valid until the pool is reset.
+void detectTextBlocksClearText(PageClearText& page, const DetectionParamsClearText& params,
+    ScratchPoolClearText* scratch = nullptr) {
+    TRACE_SCOPE_CLEARTEXT("detect");
+    Mat labels;
+    if (scratch != nullptr) {
+        Size size = page.original.size();
+        page.gray = scratch->borrow(size, CV_8UC1);
+        page.binary = scratch->borrow(size, CV_8UC1);
+        labels = scratch->borrow(size, CV_32SC1);
+    }
+
+    int hist[256];
+    grayscaleHistogramClearText(page.original, page.gray, hist);
+    binarizeGrayClearText(page.gray, hist, params, page.binary);
+
+    if (params.pyramidFactor > 1) {
+        page.dilated.release();
+        detectTextBlocksCoarseToFineClearText(page.binary, params, page.blocks);
+        return;
+    }
+
+    vector<Rect> boundingBoxes;
+    labelComponentsUnionFindClearText(page.binary, labels, boundingBoxes, nullptr, 0, params.connectivity);
+    TRACE_COUNTER_CLEARTEXT("components_found", boundingBoxes.size());
+
+    formTextBlocksClearText(page, labels, boundingBoxes, params, scratch);
+}
+
+// Sets the mask bits of the black pixels of binary inside rect: the words the
+// rect spans are packed whole and trimmed to it at both ends.
+void maskBlackPixelsClearText(const Mat& binary, Rect rect, BitplaneClearText& mask) {
+    if (rect.empty()) {
+        return;
+    }
+    int firstWord = rect.x >> 6;
+    int lastWord = (rect.x + rect.width - 1) >> 6;
+    int packBegin = firstWord * 64;
+    int packEnd = min(binary.cols, (lastWord + 1) * 64);
+    int endBit = (rect.x + rect.width) & 63;
+    uint64 firstMask = ~(uint64)0 << (rect.x & 63);
+    uint64 lastMask = endBit == 0 ? ~(uint64)0 : ((uint64)1 << endBit) - 1;
+
+    vector<uint64> packed(lastWord - firstWord + 1);
+    for (int i = rect.y; i < rect.y + rect.height; i++) {
+        packBinaryRowClearText(binary.ptr<uchar>(i) + packBegin, packEnd - packBegin, packed.data());
+        packed.front() &= firstMask;
+        packed.back() &= lastMask;
+        uint64* maskRow = mask.row(i) + firstWord;
+        for (size_t w = 0; w < packed.size(); w++) {
+            maskRow[w] |= packed[w];
+        }
+    }
+}
+
+// Set bits = text pixels to inpaint: the black pixels inside the blocks. Bands
+// of rows run in parallel, each OR-ing the part of every block inside it, so
+// overlapping blocks never write the same word from two threads.
+void buildTextMaskClearText(const Mat& binary, const vector<TextBlockClearText>& blocks, BitplaneClearText& mask) {
+    TRACE_SCOPE_CLEARTEXT("mask_build");
+    mask.create(binary.rows, binary.cols);
+
+    parallelForClearText(Range(0, binary.rows), [&](const Range& range) {
+        mask.words.rowRange(range.start, range.end).setTo(0);
+        Rect band(0, range.start, binary.cols, range.end - range.start);
+        for (const auto& block : blocks) {
+            maskBlackPixelsClearText(binary, block.boundingBox & band, mask);
+        }
+    });
+    TRACE_COUNTER_CLEARTEXT("masked_pixels", mask.count());
+}
+
+// Same from a bit-packed binary: the words a rect spans are copied, trimmed to
+// it at both ends.
+void maskBlackBitsClearText(const BitplaneClearText& binary, Rect rect, BitplaneClearText& mask) {
+    if (rect.empty()) {
+        return;
+    }
+    int firstWord = rect.x >> 6;
+    int lastWord = (rect.x + rect.width - 1) >> 6;
+    int endBit = (rect.x + rect.width) & 63;
+    uint64 firstMask = ~(uint64)0 << (rect.x & 63);
+    uint64 lastMask = endBit == 0 ? ~(uint64)0 : ((uint64)1 << endBit) - 1;
+
+    for (int i = rect.y; i < rect.y + rect.height; i++) {
+        const uint64* binaryRow = binary.row(i);
+        uint64* maskRow = mask.row(i);
+        for (int w = firstWord; w <= lastWord; w++) {
+            uint64 bits = binaryRow[w];
+            if (w == firstWord) {
+                bits &= firstMask;
+            }
+            if (w == lastWord) {
+                bits &= lastMask;
+            }
+            maskRow[w] |= bits;
+        }
+    }
+}
+
+void buildTextMaskBitsClearText(const BitplaneClearText& binary, const vector<TextBlockClearText>& blocks,
+    BitplaneClearText& mask) {
+    TRACE_SCOPE_CLEARTEXT("mask_build");
+    mask.create(binary.rows(), binary.cols);
+
+    parallelForClearText(Range(0, binary.rows()), [&](const Range& range) {
+        mask.words.rowRange(range.start, range.end).setTo(0);
+        Rect band(0, range.start, binary.cols, range.end - range.start);
+        for (const auto& block : blocks) {
+            maskBlackBitsClearText(binary, block.boundingBox & band, mask);
+        }
+    });
+    TRACE_COUNTER_CLEARTEXT("masked_pixels", mask.count());
+}
+
+// Tiled detection for very large scans. The page is cut into full-width bands
+// sized from memoryBudget, which covers the detection buffers only (the decoded
+// page itself comes on top, 3 bytes per pixel); a band
+// of binary/labels is recomputed from the source when needed instead of
+// keeping any full-page intermediate. Components crossing band borders are
+// stitched, and each dilated band gets a halo of kernel.height / 2 rows from
+// its neighbors (full-width bands need no horizontal halo), so the blocks are
+// identical to detectTextBlocksClearText on the whole page.
+int detectTextBlocksTiledClearText(const Mat& original, const DetectionParamsClearText& params,
+    size_t memoryBudget, vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("detect_tiled");
+    int rows = original.rows;
+    int cols = original.cols;
+    Size kernel = blockKernelClearText(params);
+    int above = kernel.height / 2;
+    int below = kernel.height - 1 - above;
+
+    // Per band pixel: gray 1, binary 1, labels 4, three painted bands alive at
+    // once 3, halo 1, dilated labels 4, and the extended binary of a local
+    // threshold 1.
+    const size_t bytesPerPixel = 14 + (params.binarization == BinarizationModeClearText::GlobalIterative ? 0 : 1);
+    size_t budgetRows = memoryBudget / max<size_t>(1, (size_t)cols * bytesPerPixel);
+    int bandRows = (int)min<size_t>(rows, max<size_t>(budgetRows, kernel.height));
+    int numBands = (rows + bandRows - 1) / bandRows;
+
+    auto bandStart = [&](int b) { return min(rows, b * bandRows); };
+
+    Mat gray, binary, labels;
+    int T = -1;
+    if (params.binarization == BinarizationModeClearText::GlobalIterative) {
+        int hist[256] = { 0 };
+        for (int b = 0; b < numBands; b++) {
+            int bandHist[256];
+            grayscaleHistogramClearText(original.rowRange(bandStart(b), bandStart(b + 1)), gray, bandHist);
+            for (int v = 0; v < 256; v++) {
+                hist[v] += bandHist[v];
+            }
+        }
+        T = computeAutoThresholdClearText(hist);
+    }
+
+    auto binarizeBand = [&](int b) {
+        binarizeRegionClearText(original, Rect(0, bandStart(b), cols, bandStart(b + 1) - bandStart(b)),
+            T, params, gray, binary);
+    };
+
+    ComponentStitcherClearText componentStitcher;
+    componentStitcher.connectivity = params.connectivity;
+    vector<int> bandBase(numBands);
+    vector<ComponentAccumulatorClearText> pieces;
+    for (int b = 0; b < numBands; b++) {
+        binarizeBand(b);
+        labelComponentsAccumulateClearText(binary, labels, pieces, 0, params.connectivity);
+        for (auto& piece : pieces) {
+            piece.shiftY(bandStart(b));
+        }
+        bandBase[b] = componentStitcher.addBand(binary, labels, pieces);
+    }
+
+    vector<ComponentAccumulatorClearText> components;
+    vector<int> finalLabel;
+    componentStitcher.resolve(components, finalLabel);
+    TRACE_COUNTER_CLEARTEXT("components_found", components.size());
+
+    if (params.blockFormation == BlockFormationModeClearText::BoxClustering) {
+        vector<Rect> boundingBoxes;
+        for (const auto& component : components) {
+            boundingBoxes.push_back(component.boundingBox());
+        }
+        clusterTextBlocksClearText(boundingBoxes, original.size(), params, blocks);
+        return T;
+    }
+
+    vector<bool> keepComponent(components.size());
+    for (size_t c = 0; c < components.size(); c++) {
+        keepComponent[c] = isTextComponentClearText(components[c].boundingBox(), original.size(), params);
+    }
+    TRACE_COUNTER_CLEARTEXT("components_kept", count(keepComponent.begin(), keepComponent.end(), true));
+
+    auto paintBand = [&](int b) {
+        binarizeBand(b);
+        labelComponentsAccumulateClearText(binary, labels, pieces, 0, params.connectivity);
+
+        Mat painted(binary.rows, cols, CV_8UC1);
+        for (int i = 0; i < binary.rows; i++) {
+            const int* labelRow = labels.ptr<int>(i);
+            uchar* paintedRow = painted.ptr<uchar>(i);
+            for (int j = 0; j < cols; j++) {
+                int label = labelRow[j];
+                paintedRow[j] = label > 0 && keepComponent[finalLabel[bandBase[b] + label - 1] - 1] ? 0 : 255;
+            }
+        }
+        return painted;
+    };
+
+    ComponentStitcherClearText blockStitcher;
+    blockStitcher.connectivity = params.connectivity;
+    vector<Mat> paintedBands(numBands);
+    Mat halo, dilatedLabels;
+    for (int b = 0; b <= numBands; b++) {
+        if (b < numBands) {
+            paintedBands[b] = paintBand(b);
+        }
+
+        int d = b - 1;
+        if (d < 0) {
+            continue;
+        }
+
+        int haloStart = max(0, bandStart(d) - above);
+        int haloEnd = min(rows, bandStart(d + 1) + below);
+        halo.create(haloEnd - haloStart, cols, CV_8UC1);
+        for (int n = max(0, d - 1); n <= min(numBands - 1, d + 1); n++) {
+            int from = max(haloStart, bandStart(n));
+            int to = min(haloEnd, bandStart(n + 1));
+            if (from < to) {
+                paintedBands[n].rowRange(from - bandStart(n), to - bandStart(n))
+                    .copyTo(halo.rowRange(from - haloStart, to - haloStart));
+            }
+        }
+        dilateRectClearText(halo, halo, kernel);
+
+        Mat dilatedBand = halo.rowRange(bandStart(d) - haloStart, bandStart(d + 1) - haloStart);
+        labelComponentsAccumulateClearText(dilatedBand, dilatedLabels, pieces, 0, params.connectivity);
+        for (auto& piece : pieces) {
+            piece.shiftY(bandStart(d));
+        }
+        blockStitcher.addBand(dilatedBand, dilatedLabels, pieces);
+
+        if (d > 0) {
+            paintedBands[d - 1].release();
+        }
+    }
+
+    vector<ComponentAccumulatorClearText> finalComponents;
+    blockStitcher.resolve(finalComponents, finalLabel);
+
+    blocks.clear();
+    for (const auto& component : finalComponents) {
+        Rect box = component.boundingBox();
+        if (isTextBlockClearText(box, original.size(), params)) {
+            blocks.push_back(TextBlockClearText(box, (int)blocks.size()));
+        }
+    }
+    TRACE_COUNTER_CLEARTEXT("blocks", blocks.size());
+
+    return T;
+}
+
+// Tiled counterpart of reconstructPageClearText: the text mask is rebuilt per
+// inpainting region from the source pixels, so no full-page mask is needed.
+// image is inpainted in place; T is the value returned by the tiled detection.
+// All region masks are built before any region is inpainted, because the local
+// binarization modes read pixels around a region that may belong to another one.
+void inpaintTiledClearText(Mat& image, int T, const DetectionParamsClearText& params,
+    const vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("inpainting");
+    vector<Rect> regions = inpaintRegionsClearText(blocks, image.size(), 2);
+    vector<BitplaneClearText> regionMasks(regions.size());
+    Mat gray, binary;
+
+    for (size_t r = 0; r < regions.size(); r++) {
+        const Rect& roi = regions[r];
+        binarizeRegionClearText(image, roi, T, params, gray, binary);
+
+        BitplaneClearText& regionMask = regionMasks[r];
+        regionMask.create(roi.height, roi.width);
+        regionMask.clear();
+        for (const auto& block : blocks) {
+            Rect inside = block.boundingBox & roi;
+            if (!inside.empty()) {
+                maskBlackPixelsClearText(binary, inside - roi.tl(), regionMask);
+            }
+        }
+    }
+
+    int layers = 0;
+    for (size_t r = 0; r < regions.size(); r++) {
+        TRACE_COUNTER_CLEARTEXT("masked_pixels", regionMasks[r].count());
+        layers = max(layers, inpaintRegionFrontierClearText(image, regionMasks[r], regions[r].tl(), regions[r]));
+    }
+    TRACE_COUNTER_CLEARTEXT("inpaint_iterations", layers);
+}
+
+// Hershey text metrics without calling getTextSize per candidate string: the
+// width OpenCV reports is round(sum of glyph advances * scale + thickness) and the
+// height round((cap + base line) * scale + (thickness + 1) / 2), so advances are
+// read once at scale 1 and every line width is a running sum.
+struct FontMetricsClearText {
+    int fontFace;
+    int thickness;
+    int advance[128];
+    int capPlusBase;
+
+    FontMetricsClearText(int face, int lineThickness) : fontFace(face), thickness(lineThickness) {
+        for (int c = 0; c < 128; c++) {
+            advance[c] = c < ' ' ? 0 : getTextSize(string(1, (char)c), face, 1.0, 0, nullptr).width;
+        }
+        capPlusBase = getTextSize("Ag", face, 1.0, 0, nullptr).height;
+    }
+
+    int wordAdvance(const string& word) const {
+        int sum = 0;
+        for (unsigned char c : word) {
+            if (c >= 128) {
+                return getTextSize(word, fontFace, 1.0, 0, nullptr).width;
+            }
+            sum += advance[c];
+        }
+        return sum;
+    }
+
+    int width(int advanceSum, double scale) const {
+        return cvRound(advanceSum * scale + thickness);
+    }
+
+    int height(double scale) const {
+        return cvRound(capPlusBase * scale + (thickness + 1) / 2);
+    }
+};
+
+struct TextLayoutClearText {
+    double fontScale = 0;
+    int lineHeight = 0;
+    vector<string> lines;
+    vector<int> lineAdvances;
+};
+
+// Greedy word wrap; lineWidth(advanceSum) gives the drawn width of a line at the
+// size being tried. Returns the number of lines, or -1 when a single word is
+// wider than maxWidth and allowOverflow is false (it then gets a line of its
+// own). lineEnds receives the index after the last word of every line.
+template <typename LineWidth>
+int wrapWordsClearText(const vector<int>& wordAdvances, int spaceAdvance, LineWidth lineWidth, int maxWidth,
+    bool allowOverflow, vector<int>* lineEnds) {
+    if (lineEnds) {
+        lineEnds->clear();
+    }
+    int numLines = 0;
+    int lineAdvance = -1;
+    for (size_t w = 0; w < wordAdvances.size(); w++) {
+        if (lineAdvance >= 0 && lineWidth(lineAdvance + spaceAdvance + wordAdvances[w]) <= maxWidth) {
+            lineAdvance += spaceAdvance + wordAdvances[w];
+            continue;
+        }
+        if (lineWidth(wordAdvances[w]) > maxWidth && !allowOverflow) {
+            return -1;
+        }
+        if (lineAdvance >= 0 && lineEnds) {
+            lineEnds->push_back((int)w);
+        }
+        lineAdvance = wordAdvances[w];
+        numLines++;
+    }
+    if (lineAdvance >= 0 && lineEnds) {
+        lineEnds->push_back((int)wordAdvances.size());
+    }
+    return numLines;
+}
+
+// Largest font scale in [minScale, maxScale], in steps of 0.01, at which the
+// wrapped text fits in box (minus the 3 px padding on each side), found by binary
+// search; falls back to minScale with overflowing words on their own lines.
+TextLayoutClearText fitTextClearText(const FontMetricsClearText& metrics, const string& text, Size box,
+    double minScale = 0.8, double maxScale = 3.0) {
+    vector<string> words;
+    istringstream iss(text);
+    string word;
+    while (iss >> word) {
+        words.push_back(word);
+    }
+
+    vector<int> wordAdvances(words.size());
+    for (size_t w = 0; w < words.size(); w++) {
+        wordAdvances[w] = metrics.wordAdvance(words[w]);
+    }
+    int spaceAdvance = metrics.advance[' '];
+    int maxWidth = box.width - 6;
+    int maxHeight = box.height - 6;
+
+    auto fits = [&](double scale) {
+        auto lineWidth = [&](int advance) { return metrics.width(advance, scale); };
+        int numLines = wrapWordsClearText(wordAdvances, spaceAdvance, lineWidth, maxWidth, false, nullptr);
+        return numLines > 0 && numLines * (metrics.height(scale) + 2) <= maxHeight;
+    };
+
+    int lo = cvRound(minScale * 100);
+    int hi = cvRound(maxScale * 100);
+    if (!fits(lo / 100.0)) {
+        hi = lo;
+    }
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (fits(mid / 100.0)) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    double best = lo / 100.0;
+
+    TextLayoutClearText layout;
+    layout.fontScale = best;
+    layout.lineHeight = metrics.height(best) + 3;
+
+    vector<int> lineEnds;
+    auto lineWidth = [&](int advance) { return metrics.width(advance, best); };
+    wrapWordsClearText(wordAdvances, spaceAdvance, lineWidth, maxWidth, true, &lineEnds);
+    size_t first = 0;
+    for (int end : lineEnds) {
+        string line = words[first];
+        int lineAdvance = wordAdvances[first];
+        for (size_t w = first + 1; w < (size_t)end; w++) {
+            line += " " + words[w];
+            lineAdvance += spaceAdvance + wordAdvances[w];
+        }
+        layout.lines.push_back(line);
+        layout.lineAdvances.push_back(lineAdvance);
+        first = end;
+    }
+    return layout;
+}
+
+void appendUtf8ClearText(string& out, unsigned codePoint) {
+    if (codePoint < 0x80) {
+        out += (char)codePoint;
+    }
+    else if (codePoint < 0x800) {
+        out += (char)(0xC0 | (codePoint >> 6));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000) {
+        out += (char)(0xE0 | (codePoint >> 12));
+        out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+    else {
+        out += (char)(0xF0 | (codePoint >> 18));
+        out += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// UTF-8 to code points; a malformed sequence gives U+FFFD and resumes at the
+// next byte.
+void decodeUtf8ClearText(const string& text, vector<unsigned>& codePoints) {
+    codePoints.clear();
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char lead = (unsigned char)text[i];
+        int length = lead < 0x80 ? 1 : (lead >> 5) == 6 ? 2 : (lead >> 4) == 14 ? 3 : (lead >> 3) == 30 ? 4 : 0;
+        unsigned codePoint = length == 1 ? lead : length == 2 ? lead & 0x1F : length == 3 ? lead & 0x0F : lead & 0x07;
+        bool valid = length > 0 && i + length <= text.size();
+        for (int k = 1; valid && k < length; k++) {
+            unsigned char next = (unsigned char)text[i + k];
+            valid = (next & 0xC0) == 0x80;
+            codePoint = (codePoint << 6) | (next & 0x3F);
+        }
+        if (!valid) {
+            codePoints.push_back(0xFFFD);
+            i++;
+            continue;
+        }
+        codePoints.push_back(codePoint);
+        i += length;
+    }
+}
+
+// One glyph of a strike: its coverage mask in the atlas image, the offset of
+// the mask's top-left corner from the pen position on the baseline, and the
+// pen advance.
+struct GlyphClearText {
+    unsigned codePoint = 0;
+    Rect atlasRect;
+    Point offset;
+    int advance = 0;
+};
+
+// The glyphs of one pixel size, sorted by code point. ascent/descent bound the
+// masks above and below the baseline.
+struct GlyphStrikeClearText {
+    int pixelHeight = 0;
+    int ascent = 0;
+    int descent = 0;
+    int fallback = 0;
+    vector<GlyphClearText> glyphs;
+
+    // The glyph of codePoint, or '?' for characters the atlas does not have.
+    const GlyphClearText& find(unsigned codePoint) const {
+        auto it = lower_bound(glyphs.begin(), glyphs.end(), codePoint,
+            [](const GlyphClearText& glyph, unsigned c) { return glyph.codePoint < c; });
+        return it != glyphs.end() && it->codePoint == codePoint ? *it : glyphs[fallback];
+    }
+
+    int advance(const vector<unsigned>& codePoints) const {
+        int sum = 0;
+        for (unsigned c : codePoints) {
+            sum += find(c).advance;
+        }
+        return sum;
+    }
+
+    void finish() {
+        sort(glyphs.begin(), glyphs.end(),
+            [](const GlyphClearText& a, const GlyphClearText& b) { return a.codePoint < b.codePoint; });
+        ascent = descent = 0;
+        for (size_t g = 0; g < glyphs.size(); g++) {
+            ascent = max(ascent, -glyphs[g].offset.y);
+            descent = max(descent, glyphs[g].offset.y + glyphs[g].atlasRect.height);
+            if (glyphs[g].codePoint == '?') {
+                fallback = (int)g;
+            }
+        }
+    }
+};
+
+// Prerendered font: 8-bit coverage masks of every strike packed into one
+// image, 16 levels (the precision of the .atlas files).
+struct GlyphAtlasClearText {
+    Mat alpha;
+    vector<GlyphStrikeClearText> strikes;
+};
+
+// Romanian letters and the typography of Romanian books, built from ASCII
+// glyphs plus a drawn mark when the source font has no such characters.
+enum class GlyphMarkClearText {
+    None,
+    Breve,
+    Circumflex,
+    DotlessCircumflex,
+    CommaBelow,
+    Dash,
+};
+
+struct GlyphRecipeClearText {
+    unsigned codePoint;
+    string base;
+    GlyphMarkClearText mark;
+};
+
+static const GlyphRecipeClearText g_glyphRecipesClearText[] = {
+    { 0x0102, "A", GlyphMarkClearText::Breve },
+    { 0x0103, "a", GlyphMarkClearText::Breve },
+    { 0x00C2, "A", GlyphMarkClearText::Circumflex },
+    { 0x00E2, "a", GlyphMarkClearText::Circumflex },
+    { 0x00CE, "I", GlyphMarkClearText::Circumflex },
+    { 0x00EE, "i", GlyphMarkClearText::DotlessCircumflex },
+    { 0x0218, "S", GlyphMarkClearText::CommaBelow },
+    { 0x0219, "s", GlyphMarkClearText::CommaBelow },
+    { 0x021A, "T", GlyphMarkClearText::CommaBelow },
+    { 0x021B, "t", GlyphMarkClearText::CommaBelow },
+    // Cedilla forms from legacy encodings, drawn like the comma ones.
+    { 0x015E, "S", GlyphMarkClearText::CommaBelow },
+    { 0x015F, "s", GlyphMarkClearText::CommaBelow },
+    { 0x0162, "T", GlyphMarkClearText::CommaBelow },
+    { 0x0163, "t", GlyphMarkClearText::CommaBelow },
+    { 0x00AB, "<<", GlyphMarkClearText::None },
+    { 0x00BB, ">>", GlyphMarkClearText::None },
+    { 0x2013, "-", GlyphMarkClearText::None },
+    { 0x2014, "-", GlyphMarkClearText::Dash },
+    { 0x2018, "'", GlyphMarkClearText::None },
+    { 0x2019, "'", GlyphMarkClearText::None },
+    { 0x201C, "\"", GlyphMarkClearText::None },
+    { 0x201D, "\"", GlyphMarkClearText::None },
+    { 0x201E, ",,", GlyphMarkClearText::None },
+    { 0x2026, "...", GlyphMarkClearText::None },
+};
+
+vector<GlyphRecipeClearText> glyphRecipesClearText() {
+    vector<GlyphRecipeClearText> recipes;
+    for (int c = ' '; c <= '~'; c++) {
+        recipes.push_back({ (unsigned)c, string(1, (char)c), GlyphMarkClearText::None });
+    }
+    recipes.insert(recipes.end(), begin(g_glyphRecipesClearText), end(g_glyphRecipesClearText));
+    return recipes;
+}
+
+// Pixel heights of the strikes: the range of the fitted font sizes (about 0.8
+// to 3 times the Hershey size), in steps of about 8%.
+vector<int> glyphStrikeHeightsClearText() {
+    vector<int> heights;
+    for (int h = 16; h <= 72; h = max(h + 1, cvRound(h * 1.08))) {
+        heights.push_back(h);
+    }
+    return heights;
+}
+
+// Smallest rectangle holding every nonzero pixel of mask.
+Rect inkBoundsClearText(const Mat& mask) {
+    int x0 = mask.cols, y0 = mask.rows, x1 = -1, y1 = -1;
+    for (int i = 0; i < mask.rows; i++) {
+        const uchar* row = mask.ptr<uchar>(i);
+        for (int j = 0; j < mask.cols; j++) {
+            if (row[j]) {
+                x0 = min(x0, j);
+                x1 = max(x1, j);
+                y0 = min(y0, i);
+                y1 = max(y1, i);
+            }
+        }
+    }
+    return x1 < 0 ? Rect() : Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+// Draws a glyph of the built-in Hershey font on canvas with the pen at origin
+// and returns its advance: the recipe's ASCII base, antialiased, plus its mark.
+int rasterizeHersheyGlyphClearText(const GlyphRecipeClearText& recipe, int pixelHeight, Mat& canvas, Point origin) {
+    const int face = FONT_HERSHEY_SIMPLEX;
+    const int thickness = 2;
+    double scale = (pixelHeight - 1) / (double)getTextSize("Ag", face, 1.0, 0, nullptr).height;
+    int advance = getTextSize(recipe.base, face, scale, 0, nullptr).width;
+    putText(canvas, recipe.base, origin, face, scale, Scalar(255), thickness, LINE_AA);
+    if (recipe.mark == GlyphMarkClearText::None) {
+        return advance;
+    }
+
+    Rect ink = inkBoundsClearText(canvas);
+    int gap = max(1, pixelHeight / 12);
+    int markHeight = max(3, pixelHeight / 6);
+    int markWidth = max(markHeight + 1, ink.width * 3 / 5);
+    int cx = ink.x + ink.width / 2;
+
+    if (recipe.mark == GlyphMarkClearText::DotlessCircumflex) {
+        // Remove the dot of the i: everything above the x-height.
+        Mat x = Mat::zeros(canvas.size(), CV_8UC1);
+        putText(x, "x", origin, face, scale, Scalar(255), thickness, LINE_AA);
+        int xTop = inkBoundsClearText(x).y;
+        canvas.rowRange(0, max(0, xTop - 1)).setTo(Scalar(0));
+        ink = inkBoundsClearText(canvas);
+    }
+
+    switch (recipe.mark) {
+    case GlyphMarkClearText::Breve:
+        ellipse(canvas, Point(cx, ink.y - gap - markHeight), Size(markWidth / 2, markHeight), 0, 0, 180,
+            Scalar(255), thickness, LINE_AA);
+        break;
+    case GlyphMarkClearText::Circumflex:
+    case GlyphMarkClearText::DotlessCircumflex:
+        line(canvas, Point(cx - markWidth / 2, ink.y - gap), Point(cx, ink.y - gap - markHeight), Scalar(255),
+            thickness, LINE_AA);
+        line(canvas, Point(cx, ink.y - gap - markHeight), Point(cx + markWidth / 2, ink.y - gap), Scalar(255),
+            thickness, LINE_AA);
+        break;
+    case GlyphMarkClearText::CommaBelow:
+        line(canvas, Point(cx, origin.y + gap), Point(cx - markHeight / 2, origin.y + gap + markHeight), Scalar(255),
+            thickness + 1, LINE_AA);
+        break;
+    case GlyphMarkClearText::Dash:
+        advance = getTextSize("M", face, scale, 0, nullptr).width;
+        line(canvas, Point(origin.x + 1, ink.y + ink.height / 2), Point(origin.x + advance - 2, ink.y + ink.height / 2),
+            Scalar(255), thickness, LINE_AA);
+        break;
+    default:
+        break;
+    }
+    return advance;
+}
+
+// Renders every recipe at every strike height with `rasterize` and shelf-packs
+// the cropped masks, quantized to 16 levels, into one image 1024 pixels wide.
+void buildGlyphAtlasClearText(const function<int(const GlyphRecipeClearText&, int, Mat&, Point)>& rasterize,
+    GlyphAtlasClearText& atlas) {
+    const int atlasWidth = 1024;
+    vector<GlyphRecipeClearText> recipes = glyphRecipesClearText();
+    vector<Mat> masks;
+    atlas.strikes.clear();
+
+    int shelfX = 0, shelfY = 0, shelfHeight = 0;
+    for (int pixelHeight : glyphStrikeHeightsClearText()) {
+        GlyphStrikeClearText strike;
+        strike.pixelHeight = pixelHeight;
+        for (const auto& recipe : recipes) {
+            Mat canvas = Mat::zeros(3 * pixelHeight, 5 * pixelHeight, CV_8UC1);
+            Point origin(pixelHeight, 2 * pixelHeight);
+            GlyphClearText glyph;
+            glyph.codePoint = recipe.codePoint;
+            glyph.advance = rasterize(recipe, pixelHeight, canvas, origin);
+
+            Rect ink = inkBoundsClearText(canvas);
+            Mat mask = canvas(ink).clone();
+            for (int i = 0; i < mask.rows; i++) {
+                uchar* row = mask.ptr<uchar>(i);
+                for (int j = 0; j < mask.cols; j++) {
+                    row[j] = (uchar)((row[j] * 15 + 127) / 255 * 17);
+                }
+            }
+
+            if (shelfX + ink.width > atlasWidth) {
+                shelfX = 0;
+                shelfY += shelfHeight;
+                shelfHeight = 0;
+            }
+            glyph.atlasRect = Rect(shelfX, shelfY, ink.width, ink.height);
+            glyph.offset = ink.empty() ? Point() : ink.tl() - origin;
+            shelfX += ink.width;
+            shelfHeight = max(shelfHeight, ink.height);
+
+            strike.glyphs.push_back(glyph);
+            masks.push_back(mask);
+        }
+        atlas.strikes.push_back(strike);
+    }
+
+    atlas.alpha = Mat::zeros(max(1, shelfY + shelfHeight), atlasWidth, CV_8UC1);
+    size_t m = 0;
+    for (auto& strike : atlas.strikes) {
+        for (const auto& glyph : strike.glyphs) {
+            if (!glyph.atlasRect.empty()) {
+                masks[m].copyTo(atlas.alpha(glyph.atlasRect));
+            }
+            m++;
+        }
+        strike.finish();
+    }
+}
+
+#ifdef HAVE_OPENCV_FREETYPE
+// Same from a TrueType/OpenType font, which has the Romanian letters itself.
+bool buildGlyphAtlasFromFontClearText(const string& fontPath, GlyphAtlasClearText& atlas) {
+    Ptr<freetype::FreeType2> font = freetype::createFreeType2();
+    try {
+        font->loadFontData(fontPath, 0);
+    }
+    catch (const cv::Exception&) {
+        return false;
+    }
+    // getTextSize() measures the ink box, not the pen advance, so the advance of
+    // a glyph is taken between two 'x': the ink boxes of "xcx" and "xx" differ
+    // by exactly the advance of c, side bearings and spaces included. The glyph
+    // is drawn on a color canvas, which every FreeType2 version blends into.
+    buildGlyphAtlasClearText([&](const GlyphRecipeClearText& recipe, int pixelHeight, Mat& canvas, Point origin) {
+        string text;
+        appendUtf8ClearText(text, recipe.codePoint);
+        int baseline = 0;
+        int advance = font->getTextSize("x" + text + "x", pixelHeight, -1, &baseline).width -
+            font->getTextSize("xx", pixelHeight, -1, &baseline).width;
+        Mat color = Mat::zeros(canvas.size(), CV_8UC3);
+        font->putText(color, text, origin, pixelHeight, Scalar(255, 255, 255), -1, LINE_AA, true);
+        extractChannel(color, canvas, 0);
+        return max(0, advance);
+    }, atlas);
+    return true;
+}
+#endif
+
+// .atlas file: header, strike records, glyph records, then the atlas image at
+// 4 bits per pixel (two pixels per byte, low nibble first).
+struct GlyphAtlasHeaderClearText {
+    char magic[8];
+    uint32_t version;
+    uint32_t numStrikes;
+    uint32_t numGlyphs;
+    int32_t width;
+    int32_t height;
+    uint32_t reserved;
+};
+
+struct GlyphStrikeRecordClearText {
+    int32_t pixelHeight;
+    uint32_t numGlyphs;
+};
+
+struct GlyphRecordClearText {
+    uint32_t codePoint;
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+    int16_t offsetX;
+    int16_t offsetY;
+    int16_t advance;
+    int16_t reserved;
+};
+
+const char g_glyphAtlasMagicClearText[8] = { 'C', 'L', 'R', 'T', 'X', 'T', 'G', 'A' };
+const uint32_t g_glyphAtlasVersionClearText = 1;
+
+bool writeGlyphAtlasClearText(const string& path, const GlyphAtlasClearText& atlas) {
+    GlyphAtlasHeaderClearText header = {};
+    memcpy(header.magic, g_glyphAtlasMagicClearText, sizeof(header.magic));
+    header.version = g_glyphAtlasVersionClearText;
+    header.numStrikes = (uint32_t)atlas.strikes.size();
+    header.width = atlas.alpha.cols;
+    header.height = atlas.alpha.rows;
+
+    vector<GlyphStrikeRecordClearText> strikes;
+    vector<GlyphRecordClearText> glyphs;
+    for (const auto& strike : atlas.strikes) {
+        strikes.push_back({ strike.pixelHeight, (uint32_t)strike.glyphs.size() });
+        for (const auto& glyph : strike.glyphs) {
+            glyphs.push_back({ glyph.codePoint, (int16_t)glyph.atlasRect.x, (int16_t)glyph.atlasRect.y,
+                (int16_t)glyph.atlasRect.width, (int16_t)glyph.atlasRect.height, (int16_t)glyph.offset.x,
+                (int16_t)glyph.offset.y, (int16_t)glyph.advance, 0 });
+        }
+    }
+    header.numGlyphs = (uint32_t)glyphs.size();
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(strikes.data(), sizeof(GlyphStrikeRecordClearText), strikes.size(), f) == strikes.size() &&
+        fwrite(glyphs.data(), sizeof(GlyphRecordClearText), glyphs.size(), f) == glyphs.size();
+    vector<uchar> packed((atlas.alpha.cols + 1) / 2);
+    for (int i = 0; ok && i < atlas.alpha.rows; i++) {
+        const uchar* row = atlas.alpha.ptr<uchar>(i);
+        fill(packed.begin(), packed.end(), 0);
+        for (int j = 0; j < atlas.alpha.cols; j++) {
+            packed[j / 2] |= (uchar)((row[j] / 17) << (4 * (j & 1)));
+        }
+        ok = fwrite(packed.data(), 1, packed.size(), f) == packed.size();
+    }
+    return fclose(f) == 0 && ok;
+}
+
+bool readGlyphAtlasClearText(const string& path, GlyphAtlasClearText& atlas) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+
+    GlyphAtlasHeaderClearText header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+        memcmp(header.magic, g_glyphAtlasMagicClearText, sizeof(header.magic)) == 0 &&
+        header.version == g_glyphAtlasVersionClearText && header.numStrikes > 0 && header.numStrikes < 1000 &&
+        header.numGlyphs < 1000000 && header.width > 0 && header.width <= 32767 &&
+        header.height > 0 && header.height <= 32767;
+    vector<GlyphStrikeRecordClearText> strikes(ok ? header.numStrikes : 0);
+    vector<GlyphRecordClearText> glyphs(ok ? header.numGlyphs : 0);
+    ok = ok && fread(strikes.data(), sizeof(GlyphStrikeRecordClearText), strikes.size(), f) == strikes.size() &&
+        fread(glyphs.data(), sizeof(GlyphRecordClearText), glyphs.size(), f) == glyphs.size();
+
+    Mat alpha;
+    if (ok) {
+        alpha.create(header.height, header.width, CV_8UC1);
+        vector<uchar> packed((header.width + 1) / 2);
+        for (int i = 0; ok && i < header.height; i++) {
+            ok = fread(packed.data(), 1, packed.size(), f) == packed.size();
+            uchar* row = alpha.ptr<uchar>(i);
+            for (int j = 0; ok && j < header.width; j++) {
+                row[j] = (uchar)(((packed[j / 2] >> (4 * (j & 1))) & 15) * 17);
+            }
+        }
+    }
+    fclose(f);
+
+    size_t next = 0;
+    vector<GlyphStrikeClearText> loaded;
+    for (size_t s = 0; ok && s < strikes.size(); s++) {
+        GlyphStrikeClearText strike;
+        strike.pixelHeight = strikes[s].pixelHeight;
+        ok = strikes[s].numGlyphs > 0 && next + strikes[s].numGlyphs <= glyphs.size();
+        for (uint32_t g = 0; ok && g < strikes[s].numGlyphs; g++) {
+            const GlyphRecordClearText& record = glyphs[next++];
+            GlyphClearText glyph;
+            glyph.codePoint = record.codePoint;
+            glyph.atlasRect = Rect(record.x, record.y, record.width, record.height);
+            glyph.offset = Point(record.offsetX, record.offsetY);
+            glyph.advance = record.advance;
+            ok = glyph.atlasRect.x >= 0 && glyph.atlasRect.y >= 0 && glyph.atlasRect.width >= 0 &&
+                glyph.atlasRect.height >= 0 && glyph.atlasRect.x + glyph.atlasRect.width <= header.width &&
+                glyph.atlasRect.y + glyph.atlasRect.height <= header.height;
+            strike.glyphs.push_back(glyph);
+        }
+        strike.finish();
+        loaded.push_back(strike);
+    }
+    if (!ok || next != glyphs.size()) {
+        return false;
+    }
+    atlas.alpha = alpha;
+    atlas.strikes.swap(loaded);
+    return true;
+}
+
+static string g_glyphAtlasPathClearText = "cleartext.atlas";
+
+// The atlas of g_glyphAtlasPathClearText, built from the Hershey font once if
+// that file cannot be read.
+const GlyphAtlasClearText& glyphAtlasClearText() {
+    static const GlyphAtlasClearText atlas = []() {
+        GlyphAtlasClearText loaded;
+        if (!readGlyphAtlasClearText(g_glyphAtlasPathClearText, loaded)) {
+            buildGlyphAtlasClearText(rasterizeHersheyGlyphClearText, loaded);
+        }
+        return loaded;
+    }();
+    return atlas;
+}
+
+// Offline step of the renderer: builds the atlas from a TrueType/OpenType font
+// (when OpenCV has the freetype module) or from the Hershey font, and saves it.
+int buildGlyphAtlasFileClearText(const string& outputPath, const string& fontPath) {
+    GlyphAtlasClearText atlas;
+    if (fontPath.empty()) {
+        buildGlyphAtlasClearText(rasterizeHersheyGlyphClearText, atlas);
+    }
+    else {
+#ifdef HAVE_OPENCV_FREETYPE
+        if (!buildGlyphAtlasFromFontClearText(fontPath, atlas)) {
+            printf("Nu am putut incarca fontul: %s\n", fontPath.c_str());
+            return 1;
+        }
+#else
+        printf("OpenCV nu are modulul freetype; atlasul se poate construi doar din fontul Hershey\n");
+        return 1;
+#endif
+    }
+
+    if (!writeGlyphAtlasClearText(outputPath, atlas)) {
+        printf("Nu am putut scrie atlasul: %s\n", outputPath.c_str());
+        return 1;
+    }
+    size_t numGlyphs = 0;
+    for (const auto& strike : atlas.strikes) {
+        numGlyphs += strike.glyphs.size();
+    }
+    printf("Atlas salvat in %s: %zu dimensiuni (%d-%d px), %zu glife, imagine %dx%d\n", outputPath.c_str(),
+        atlas.strikes.size(), atlas.strikes.front().pixelHeight, atlas.strikes.back().pixelHeight, numGlyphs,
+        atlas.alpha.cols, atlas.alpha.rows);
+    return 0;
+}
+
+struct AtlasLayoutClearText {
+    int strike = 0;
+    int lineHeight = 0;
+    vector<vector<unsigned>> lines;
+    vector<int> lineAdvances;
+};
+
+// Largest strike at which the wrapped text fits in box (minus the 3 px padding
+// on each side), by binary search over the strikes; falls back to the smallest
+// one with overflowing words on their own lines.
+AtlasLayoutClearText fitTextAtlasClearText(const GlyphAtlasClearText& atlas, const string& text, Size box) {
+    vector<vector<unsigned>> words;
+    istringstream iss(text);
+    string word;
+    while (iss >> word) {
+        words.emplace_back();
+        decodeUtf8ClearText(word, words.back());
+    }
+
+    int maxWidth = box.width - 6;
+    int maxHeight = box.height - 6;
+    vector<int> wordAdvances(words.size());
+    auto measure = [&](const GlyphStrikeClearText& strike) {
+        for (size_t w = 0; w < words.size(); w++) {
+            wordAdvances[w] = strike.advance(words[w]);
+        }
+        return strike.find(' ').advance;
+    };
+    auto lineWidth = [](int advance) { return advance; };
+    auto fits = [&](int s) {
+        const GlyphStrikeClearText& strike = atlas.strikes[s];
+        int spaceAdvance = measure(strike);
+        int numLines = wrapWordsClearText(wordAdvances, spaceAdvance, lineWidth, maxWidth, false, nullptr);
+        return numLines > 0 && numLines * (strike.pixelHeight + 2) <= maxHeight;
+    };
+
+    int lo = 0;
+    int hi = (int)atlas.strikes.size() - 1;
+    if (!fits(lo)) {
+        hi = lo;
+    }
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (fits(mid)) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+
+    AtlasLayoutClearText layout;
+    layout.strike = lo;
+    const GlyphStrikeClearText& strike = atlas.strikes[lo];
+    layout.lineHeight = strike.pixelHeight + 3;
+    int spaceAdvance = measure(strike);
+
+    vector<int> lineEnds;
+    wrapWordsClearText(wordAdvances, spaceAdvance, lineWidth, maxWidth, true, &lineEnds);
+    size_t first = 0;
+    for (int end : lineEnds) {
+        vector<unsigned> line = words[first];
+        int lineAdvance = wordAdvances[first];
+        for (size_t w = first + 1; w < (size_t)end; w++) {
+            line.push_back(' ');
+            line.insert(line.end(), words[w].begin(), words[w].end());
+            lineAdvance += spaceAdvance + wordAdvances[w];
+        }
+        layout.lines.push_back(line);
+        layout.lineAdvances.push_back(lineAdvance);
+        first = end;
+    }
+    return layout;
+}
+
+// Draws one line with its pen starting at `pen` on the baseline. The glyph masks
+// are first merged (max) into a coverage buffer spanning the line's glyphs, one
+// contiguous row span per glyph row, and the buffer is then blended into
+// result in a single pass, clipped to the image and skipping empty runs.
+void drawAtlasLineClearText(Mat& result, const GlyphAtlasClearText& atlas, const GlyphStrikeClearText& strike,
+    const vector<unsigned>& line, Point pen, Vec3b color, Mat& coverage) {
+    Rect area;
+    int x = pen.x;
+    for (unsigned c : line) {
+        const GlyphClearText& glyph = strike.find(c);
+        if (!glyph.atlasRect.empty()) {
+            Rect target(x + glyph.offset.x, pen.y + glyph.offset.y, glyph.atlasRect.width, glyph.atlasRect.height);
+            area = area.empty() ? target : area | target;
+        }
+        x += glyph.advance;
+    }
+    Rect visible = area & Rect(0, 0, result.cols, result.rows);
+    if (visible.empty()) {
+        return;
+    }
+    coverage.create(area.height, area.width, CV_8UC1);
+    coverage.setTo(Scalar(0));
+
+    const auto maxRows = g_kernelsClearText->maxRows;
+    x = pen.x;
+    for (unsigned c : line) {
+        const GlyphClearText& glyph = strike.find(c);
+        int left = x + glyph.offset.x - area.x;
+        int top = pen.y + glyph.offset.y - area.y;
+        for (int i = 0; i < glyph.atlasRect.height; i++) {
+            uchar* dst = coverage.ptr<uchar>(top + i) + left;
+            maxRows(dst, atlas.alpha.ptr<uchar>(glyph.atlasRect.y + i) + glyph.atlasRect.x, dst, glyph.atlasRect.width);
+        }
+        x += glyph.advance;
+    }
+
+    for (int i = visible.y; i < visible.y + visible.height; i++) {
+        const uchar* a = coverage.ptr<uchar>(i - area.y) + visible.x - area.x;
+        Vec3b* dst = result.ptr<Vec3b>(i) + visible.x;
+        for (int j = 0; j < visible.width; j++) {
+            uint64 run;
+            if (j + 8 <= visible.width && (memcpy(&run, a + j, 8), run == 0)) {
+                j += 7;
+                continue;
+            }
+            int alpha = a[j];
+            if (alpha == 0) {
+                continue;
+            }
+            for (int ch = 0; ch < 3; ch++) {
+                int v = dst[j][ch] * (255 - alpha) + color[ch] * alpha + 128;
+                dst[j][ch] = (uchar)((v + (v >> 8)) >> 8);
+            }
+        }
+    }
+}
+
+// The original renderer: every line stroked with putText in the Hershey font
+// (ASCII only). Kept as the reference for the benchmark.
+void renderTranscriptionsHersheyClearText(Mat& result, const vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("text_rendering");
+    const int thickness = 1;
+    static const FontMetricsClearText metrics(FONT_HERSHEY_SIMPLEX, thickness);
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (!blocks[i].isValidated || blocks[i].transcribedText.empty()) {
+            continue;
+        }
+
+        const TextBlockClearText& block = blocks[i];
+        if (g_verboseClearText) {
+            printf("Bloc %d: rendering \"%s\"\n", block.id + 1,
+                block.transcribedText.substr(0, 30).c_str());
+            printf("   Dimensiuni bloc: %dx%d pixeli\n", block.boundingBox.width, block.boundingBox.height);
+        }
+
+        TextLayoutClearText layout = fitTextClearText(metrics, block.transcribedText, block.boundingBox.size());
+        int startY = block.boundingBox.y + layout.lineHeight;
+
+        if (g_verboseClearText) {
+            printf("   Randare: %d linii cu font %.2f\n", (int)layout.lines.size(), layout.fontScale);
+        }
+
+        for (size_t l = 0; l < layout.lines.size(); l++) {
+            int y = startY + (int)l * layout.lineHeight;
+
+            if (y > result.rows - 10) {
+                if (g_verboseClearText) {
+                    printf("   Linia %d iese din imagine\n", (int)l);
+                }
+                break;
+            }
+
+            Size lineSize(metrics.width(layout.lineAdvances[l], layout.fontScale), metrics.height(layout.fontScale));
+
+            int padding = 3;
+            Rect textBg(max(0, block.boundingBox.x - padding),
+                max(0, y - lineSize.height - padding),
+                min(result.cols - block.boundingBox.x, lineSize.width + 2 * padding),
+                lineSize.height + 2 * padding);
+
+            rectangle(result, textBg, Scalar(255, 255, 255), -1);
+
+            putText(result, layout.lines[l],
+                Point(block.boundingBox.x + 2, y),
+                FONT_HERSHEY_SIMPLEX, layout.fontScale, Scalar(0, 0, 0), thickness + 1);
+        }
+    }
+}
+
+// Draws the validated transcriptions over their blocks from the glyph atlas,
+// UTF-8 aware, at the largest strike that fits each block. The layouts (the
+// search for the strike) are computed for all blocks in parallel; drawing
+// stays in block order, as blocks may overlap.
+void renderTranscriptionsClearText(Mat& result, const vector<TextBlockClearText>& blocks) {
+    TRACE_SCOPE_CLEARTEXT("text_rendering");
+    const GlyphAtlasClearText& atlas = glyphAtlasClearText();
+    const Rect image(0, 0, result.cols, result.rows);
+    Mat coverage;
+
+    vector<AtlasLayoutClearText> layouts(blocks.size());
+    parallelForClearText(Range(0, (int)blocks.size()), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            if (blocks[i].isValidated && !blocks[i].transcribedText.empty()) {
+                layouts[i] = fitTextAtlasClearText(atlas, blocks[i].transcribedText, blocks[i].boundingBox.size());
+            }
+        }
+    });
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (!blocks[i].isValidated || blocks[i].transcribedText.empty()) {
+            continue;
+        }
+
+        const TextBlockClearText& block = blocks[i];
+        if (g_verboseClearText) {
+            printf("Bloc %d: rendering \"%s\"\n", block.id + 1,
+                block.transcribedText.substr(0, 30).c_str());
+            printf("   Dimensiuni bloc: %dx%d pixeli\n", block.boundingBox.width, block.boundingBox.height);
+        }
+
+        const AtlasLayoutClearText& layout = layouts[i];
+        const GlyphStrikeClearText& strike = atlas.strikes[layout.strike];
+        int startY = block.boundingBox.y + layout.lineHeight;
+
+        if (g_verboseClearText) {
+            printf("   Randare: %d linii cu glife de %d px\n", (int)layout.lines.size(), strike.pixelHeight);
+        }
+
+        for (size_t l = 0; l < layout.lines.size(); l++) {
+            int y = startY + (int)l * layout.lineHeight;
+
+            if (y - strike.ascent >= result.rows) {
+                if (g_verboseClearText) {
+                    printf("   Linia %d iese din imagine\n", (int)l);
+                }
+                break;
+            }
+
+            int padding = 3;
+            Rect textBg = Rect(block.boundingBox.x - padding, y - strike.pixelHeight - padding,
+                layout.lineAdvances[l] + 2 * padding, strike.pixelHeight + 2 * padding) & image;
+            if (!textBg.empty()) {
+                result(textBg).setTo(Scalar(255, 255, 255));
+            }
+            drawAtlasLineClearText(result, atlas, strike, layout.lines[l], Point(block.boundingBox.x + 2, y),
+                Vec3b(0, 0, 0), coverage);
+        }
+    }
+}
+
+void reconstructPageClearText(const PageClearText& page, Mat& backgroundOnly, Mat& result,
+    ScratchPoolClearText* scratch = nullptr) {
+    TRACE_SCOPE_CLEARTEXT("reconstruct");
+    BitplaneClearText mask;
+    if (scratch != nullptr) {
+        mask.words = scratch->borrow(BitplaneClearText::storageSize(page.original.size()), CV_8UC1);
+        backgroundOnly = scratch->borrow(page.original.size(), CV_8UC3);
+        result = scratch->borrow(page.original.size(), CV_8UC3);
+    }
+    if (page.binary.empty()) {
+        buildTextMaskBitsClearText(page.binaryBits, page.blocks, mask);
+    }
+    else {
+        buildTextMaskClearText(page.binary, page.blocks, mask);
+    }
+
+    if (g_inpaintModeClearText == InpaintModeClearText::IterativeReference) {
+        Mat maskImage;
+        if (scratch != nullptr) {
+            maskImage = scratch->borrow(page.original.size(), CV_8UC1);
+        }
+        unpackBinaryClearText(mask, maskImage);
+        simpleInpaintingClearText(page.original, maskImage).copyTo(backgroundOnly);
+    }
+    else if (g_inpaintModeClearText == InpaintModeClearText::BackgroundModel) {
+        page.original.copyTo(backgroundOnly);
+        inpaintBackgroundModelClearText(backgroundOnly, mask, backgroundModelFactorClearText(page.original.size()));
+    }
+    else {
+        page.original.copyTo(backgroundOnly);
+        inpaintFrontierClearText(backgroundOnly, mask, page.blocks);
+    }
+    backgroundOnly.copyTo(result);
+    renderTranscriptionsClearText(result, page.blocks);
+}
+
+uint64 fnv1aClearText(const void* data, size_t size, uint64 hash = 14695981039346656037ULL) {
+    const uchar* bytes = (const uchar*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Read-only memory mapping of a whole file (CreateFileMapping on Windows, mmap
+// elsewhere).
+struct MappedFileClearText {
+    const uchar* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    MappedFileClearText() {}
+    MappedFileClearText(const MappedFileClearText&) = delete;
+    MappedFileClearText& operator=(const MappedFileClearText&) = delete;
+    ~MappedFileClearText() { close(); }
+
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            data = (const uchar*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        size = (size_t)st.st_size;
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        data = view == MAP_FAILED ? nullptr : (const uchar*)view;
+#endif
+        if (!data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+uint64 fileHashClearText(const string& path) {
+    MappedFileClearText file;
+    return file.open(path) ? fnv1aClearText(file.data, file.size) : 0;
+}
+
+// What a sidecar records about its source image. Size and modification time
+// come from the file system and decide whether the sidecar is stale; the
+// content hash reads the whole image, so it is only computed with
+// --verify-sidecar (0 otherwise).
+struct SidecarSourceClearText {
+    uint64 size = 0;
+    int64 modified = 0;
+    uint64 hash = 0;
+};
+
+SidecarSourceClearText sidecarSourceClearText(const string& path) {
+    SidecarSourceClearText source;
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) {
+        return source;
+    }
+    source.size = ((uint64)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    source.modified = (int64)(((uint64)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return source;
+    }
+    source.size = (uint64)st.st_size;
+#ifdef __APPLE__
+    source.modified = (int64)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    source.modified = (int64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    if (g_verifySidecarsClearText) {
+        source.hash = fileHashClearText(path);
+    }
+    return source;
+}
+
+uint64 paramsHashClearText(const DetectionParamsClearText& params) {
+    const double values[] = {
+        (double)params.minComponentArea, (double)params.maxComponentArea,
+        (double)params.maxComponentWidthDiv, (double)params.maxComponentHeightDiv,
+        (double)params.minComponentSide, (double)params.dilationSize, (double)params.horizontalExtension,
+        (double)params.minBlockArea, (double)params.maxBlockAreaDiv,
+        (double)params.minBlockWidth, (double)params.minBlockHeight,
+        (double)params.binarization, (double)params.adaptiveWindow, params.sauvolaK, params.niblackK,
+        (double)params.blockFormation, (double)params.pyramidFactor, (double)params.connectivity,
+    };
+    return fnv1aClearText(values, sizeof(values));
+}
+
+// Per-page sidecar (<image>.cleartext) with everything detection and
+// transcription produced, so a page reopens without recomputation. Layout, all
+// little-endian and 8-byte aligned: header, binary image bit-packed as uint64
+// words per row (bit j % 64 of word j / 64 set = black pixel j), block records,
+// then the transcriptions as UTF-8. The source size and modification time and
+// the parameter hash in the header mark a sidecar as stale.
+const char g_sidecarMagicClearText[8] = { 'C', 'L', 'R', 'T', 'X', 'T', 'P', 'G' };
+const uint32_t g_sidecarVersionClearText = 2;
+
+struct SidecarHeaderClearText {
+    char magic[8];
+    uint32_t version;
+    uint32_t numBlocks;
+    uint64 sourceSize;
+    int64 sourceModified;
+    uint64 sourceHash;
+    uint64 paramsHash;
+    int32_t width;
+    int32_t height;
+    uint32_t wordsPerRow;
+    uint32_t reserved;
+    uint64 binaryOffset;
+    uint64 blocksOffset;
+    uint64 textOffset;
+    uint64 textSize;
+};
+
+struct SidecarBlockClearText {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int32_t id;
+    uint32_t flags;
+    uint32_t textOffset;
+    uint32_t textLength;
+};
+
+const uint32_t g_sidecarValidatedClearText = 1;
+
+// The binary comes from page.binary, or from page.binaryBits for a page restored
+// from a sidecar and never unpacked.
+bool writePageSidecarClearText(const string& path, PageClearText& page, const SidecarSourceClearText& source,
+    uint64 paramsHash) {
+    bool fromBytes = !page.binary.empty();
+    CV_Assert(!fromBytes || page.binary.type() == CV_8UC1);
+    Size size = fromBytes ? page.binary.size() : page.binaryBits.size();
+
+    SidecarHeaderClearText header = {};
+    memcpy(header.magic, g_sidecarMagicClearText, sizeof(header.magic));
+    header.version = g_sidecarVersionClearText;
+    header.numBlocks = (uint32_t)page.blocks.size();
+    header.sourceSize = source.size;
+    header.sourceModified = source.modified;
+    header.sourceHash = source.hash;
+    header.paramsHash = paramsHash;
+    header.width = size.width;
+    header.height = size.height;
+    header.wordsPerRow = (size.width + 63) / 64;
+    header.binaryOffset = sizeof(SidecarHeaderClearText);
+    header.blocksOffset = header.binaryOffset + (uint64)header.wordsPerRow * header.height * sizeof(uint64);
+    header.textOffset = header.blocksOffset + (uint64)header.numBlocks * sizeof(SidecarBlockClearText);
+
+    vector<SidecarBlockClearText> records;
+    string text;
+    for (const auto& block : page.blocks) {
+        SidecarBlockClearText record = {};
+        record.x = block.boundingBox.x;
+        record.y = block.boundingBox.y;
+        record.width = block.boundingBox.width;
+        record.height = block.boundingBox.height;
+        record.id = block.id;
+        record.flags = block.isValidated ? g_sidecarValidatedClearText : 0;
+        record.textOffset = (uint32_t)text.size();
+        record.textLength = (uint32_t)block.transcribedText.size();
+        text += block.transcribedText;
+        records.push_back(record);
+    }
+    header.textSize = text.size();
+
+    string tempPath = path + ".tmp";
+    FILE* f = fopen(tempPath.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    vector<uint64> words(header.wordsPerRow);
+    for (int i = 0; ok && i < size.height; i++) {
+        const uint64* row = words.data();
+        if (fromBytes) {
+            packBinaryRowClearText(page.binary.ptr<uchar>(i), size.width, words.data());
+        }
+        else {
+            row = page.binaryBits.row(i);
+        }
+        ok = fwrite(row, sizeof(uint64), words.size(), f) == words.size();
+    }
+    if (ok && !records.empty()) {
+        ok = fwrite(records.data(), sizeof(SidecarBlockClearText), records.size(), f) == records.size();
+    }
+    if (ok && !text.empty()) {
+        ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    }
+    ok = fclose(f) == 0 && ok;
+
+    // The new file replaces the old one in a single step, so a crash or a
+    // failed save leaves the previous session intact.
+#ifdef _WIN32
+    // A mapped file cannot be replaced; a page restored from this sidecar keeps
+    // its own copy of the bits from here on.
+    if (ok && page.sidecarFile) {
+        page.binaryBits.words = page.binaryBits.words.clone();
+        page.sidecarFile.reset();
+    }
+    ok = ok && MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    ok = ok && rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Restores page.binaryBits and page.blocks from a mapped sidecar. Returns false
+// (leaving the page untouched) when the file is missing, truncated, was made
+// from another source image or with other parameters, does not match the size
+// of page.original, or has a block outside the page. The binary is not copied:
+// page.binaryBits points into the mapping, which the page keeps open; only the
+// block records and their transcriptions are copied into page.blocks.
+bool loadPageSidecarClearText(const string& path, const SidecarSourceClearText& source, uint64 paramsHash,
+    PageClearText& page) {
+    auto file = make_shared<MappedFileClearText>();
+    if (!file->open(path) || file->size < sizeof(SidecarHeaderClearText)) {
+        return false;
+    }
+
+    const SidecarHeaderClearText& header = *(const SidecarHeaderClearText*)file->data;
+    if (memcmp(header.magic, g_sidecarMagicClearText, sizeof(header.magic)) != 0 ||
+        header.version != g_sidecarVersionClearText ||
+        header.sourceSize != source.size || header.sourceModified != source.modified ||
+        (source.hash != 0 && header.sourceHash != source.hash) || header.paramsHash != paramsHash ||
+        header.width <= 0 || header.height <= 0 ||
+        (!page.original.empty() && Size(header.width, header.height) != page.original.size()) ||
+        header.binaryOffset != sizeof(SidecarHeaderClearText) ||
+        header.wordsPerRow != (uint32_t)(header.width + 63) / 64 ||
+        header.blocksOffset != header.binaryOffset + (uint64)header.wordsPerRow * header.height * sizeof(uint64) ||
+        header.textOffset != header.blocksOffset + (uint64)header.numBlocks * sizeof(SidecarBlockClearText) ||
+        header.textOffset + header.textSize != file->size) {
+        return false;
+    }
+
+    const SidecarBlockClearText* records = (const SidecarBlockClearText*)(file->data + header.blocksOffset);
+    const char* text = (const char*)(file->data + header.textOffset);
+    vector<TextBlockClearText> blocks;
+    for (uint32_t b = 0; b < header.numBlocks; b++) {
+        const SidecarBlockClearText& record = records[b];
+        if ((uint64)record.textOffset + record.textLength > header.textSize) {
+            return false;
+        }
+        if (record.x < 0 || record.y < 0 || record.width <= 0 || record.height <= 0 ||
+            (int64)record.x + record.width > header.width || (int64)record.y + record.height > header.height) {
+            return false;
+        }
+        TextBlockClearText block(Rect(record.x, record.y, record.width, record.height), record.id);
+        block.transcribedText.assign(text + record.textOffset, record.textLength);
+        block.isValidated = (record.flags & g_sidecarValidatedClearText) != 0;
+        blocks.push_back(block);
+    }
+
+    // The mapping is read-only: nothing writes to binaryBits of a restored page.
+    page.binary.release();
+    page.binaryBits.cols = header.width;
+    page.binaryBits.wordsPerRow = (int)header.wordsPerRow;
+    page.binaryBits.words = Mat(header.height, (int)header.wordsPerRow * (int)sizeof(uint64), CV_8UC1,
+        (void*)(file->data + header.binaryOffset));
+    page.sidecarFile = file;
+    page.blocks.swap(blocks);
+    return true;
+}
+
+string sidecarPathClearText(const string& imagePath) {
+    return imagePath + ".cleartext";
+}
+
+string fileNameClearText(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    if (slash == string::npos) {
+        return path;
+    }
+    return path.substr(slash + 1);
+}
+
+string fileDirectoryClearText(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    if (slash == string::npos) {
+        return ".";
+    }
+    return path.substr(0, slash);
+}
+
+string fileStemClearText(const string& path) {
+    string name = fileNameClearText(path);
+    size_t dot = name.find_last_of('.');
+    if (dot == string::npos) {
+        return name;
+    }
+    return name.substr(0, dot);
+}
+
+bool isImageFileClearText(const string& path) {
+    string name = fileNameClearText(path);
+    size_t dot = name.find_last_of('.');
+    if (dot == string::npos) {
+        return false;
+    }
+
+    string ext = name.substr(dot + 1);
+    for (auto& c : ext) {
+        c = (char)tolower((unsigned char)c);
+    }
+    return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp" ||
+        ext == "tif" || ext == "tiff" || ext == "pgm" || ext == "ppm";
+}
+
+bool writeBlocksFileClearText(const string& path, const vector<TextBlockClearText>& blocks) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        return false;
+    }
+
+    for (const auto& block : blocks) {
+        fprintf(f, "%d %d %d %d\n", block.boundingBox.x, block.boundingBox.y,
+            block.boundingBox.width, block.boundingBox.height);
+    }
+    fclose(f);
+    return true;
+}
+
+// One transcribed region of an OCR file (a line, or a word when the file has no
+// lines), in page pixels.
+struct TranscriptItemClearText {
+    Rect box;
+    string text;
+};
+
+// "#123" or "#x1F": at least one digit and nothing else after the '#' (or "#x").
+// Anything else, "#x" or "#abc" included, is not a reference and stays as typed.
+bool isNumericReferenceClearText(const string& entity) {
+    bool hex = entity.size() > 1 && (entity[1] == 'x' || entity[1] == 'X');
+    size_t first = hex ? 2 : 1;
+    if (entity.size() <= first) {
+        return false;
+    }
+    for (size_t k = first; k < entity.size(); k++) {
+        int c = (unsigned char)entity[k];
+        if (hex ? !isxdigit(c) : !isdigit(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Element content as plain text: tags become spaces, entities are decoded and
+// runs of whitespace collapse to one space.
+string hocrPlainTextClearText(const string& html, size_t begin, size_t end) {
+    string text;
+    auto addSpace = [&]() {
+        if (!text.empty() && text.back() != ' ') {
+            text += ' ';
+        }
+    };
+
+    for (size_t i = begin; i < end; i++) {
+        char c = html[i];
+        if (c == '<') {
+            size_t close = html.find('>', i);
+            i = close == string::npos || close >= end ? end : close;
+            addSpace();
+        }
+        else if (c == '&') {
+            size_t semicolon = html.find(';', i);
+            if (semicolon == string::npos || semicolon >= end || semicolon - i > 10) {
+                text += c;
+                continue;
+            }
+            string entity = html.substr(i + 1, semicolon - i - 1);
+            if (entity == "amp") text += '&';
+            else if (entity == "lt") text += '<';
+            else if (entity == "gt") text += '>';
+            else if (entity == "quot") text += '"';
+            else if (entity == "apos") text += '\'';
+            else if (entity == "nbsp") addSpace();
+            else if (entity.size() > 1 && entity[0] == '#' && isNumericReferenceClearText(entity)) {
+                // NUL, surrogates and values past U+10FFFF are not characters; like
+                // the JSON reader, they become U+FFFD.
+                bool hex = entity[1] == 'x' || entity[1] == 'X';
+                unsigned long codePoint = strtoul(entity.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10);
+                if (codePoint == 0 || (codePoint >= 0xD800 && codePoint < 0xE000) || codePoint > 0x10FFFF) {
+                    codePoint = 0xFFFD;
+                }
+                appendUtf8ClearText(text, (unsigned)codePoint);
+            }
+            else {
+                text += html.substr(i, semicolon - i + 1);
+            }
+            i = semicolon;
+        }
+        else if (isspace((unsigned char)c)) {
+            addSpace();
+        }
+        else {
+            text += c;
+        }
+    }
+    if (!text.empty() && text.back() == ' ') {
+        text.pop_back();
+    }
+    return text;
+}
+
+// Value of attribute `name` in the attribute text of a start tag, "" if absent.
+string hocrAttributeClearText(const string& attributes, const string& name) {
+    size_t at = 0;
+    while ((at = attributes.find(name, at)) != string::npos) {
+        size_t equals = at + name.size();
+        bool wholeName = at == 0 || isspace((unsigned char)attributes[at - 1]);
+        if (wholeName && equals < attributes.size() && attributes[equals] == '=' && equals + 1 < attributes.size()) {
+            char quote = attributes[equals + 1];
+            if (quote == '"' || quote == '\'') {
+                size_t close = attributes.find(quote, equals + 2);
+                return attributes.substr(equals + 2, close == string::npos ? string::npos : close - equals - 2);
+            }
+        }
+        at = equals;
+    }
+    return "";
+}
+
+bool hocrHasClassClearText(const string& classes, const char* name) {
+    istringstream iss(classes);
+    string token;
+    while (iss >> token) {
+        if (token == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// hOCR (Tesseract, ABBYY, OCRopus, ...): every element of one of `classes`, with
+// the "bbox x0 y0 x1 y1" of its title attribute and its content as text.
+void parseHocrElementsClearText(const string& html, const vector<const char*>& classes,
+    vector<TranscriptItemClearText>& items) {
+    size_t at = 0;
+    while ((at = html.find('<', at)) != string::npos) {
+        size_t close = html.find('>', at);
+        if (close == string::npos) {
+            break;
+        }
+        size_t nameEnd = at + 1;
+        while (nameEnd < close && !isspace((unsigned char)html[nameEnd]) && html[nameEnd] != '/') {
+            nameEnd++;
+        }
+        string tag = html.substr(at + 1, nameEnd - at - 1);
+        string attributes = html.substr(nameEnd, close - nameEnd);
+        size_t contentBegin = close + 1;
+        at = contentBegin;
+        if (tag.empty() || !isalpha((unsigned char)tag[0]) || (!attributes.empty() && attributes.back() == '/')) {
+            continue;
+        }
+
+        string classAttribute = hocrAttributeClearText(attributes, "class");
+        bool wanted = false;
+        for (const char* name : classes) {
+            wanted |= hocrHasClassClearText(classAttribute, name);
+        }
+        int x0, y0, x1, y1;
+        string title = hocrAttributeClearText(attributes, "title");
+        size_t bbox = title.find("bbox ");
+        if (!wanted || bbox == string::npos || sscanf(title.c_str() + bbox + 5, "%d %d %d %d", &x0, &y0, &x1, &y1) != 4) {
+            continue;
+        }
+
+        // Matching end tag, counting nested elements of the same name.
+        int depth = 1;
+        size_t scan = contentBegin;
+        size_t contentEnd = html.size();
+        while (depth > 0 && (scan = html.find('<', scan)) != string::npos) {
+            bool isEnd = scan + 1 < html.size() && html[scan + 1] == '/';
+            size_t nameAt = scan + (isEnd ? 2 : 1);
+            size_t tagClose = html.find('>', scan);
+            if (tagClose == string::npos) {
+                break;
+            }
+            if (html.compare(nameAt, tag.size(), tag) == 0 &&
+                (nameAt + tag.size() == tagClose || isspace((unsigned char)html[nameAt + tag.size()]))) {
+                if (isEnd) {
+                    depth--;
+                    contentEnd = scan;
+                }
+                else if (html[tagClose - 1] != '/') {
+                    depth++;
+                }
+            }
+            scan = tagClose + 1;
+        }
+
+        TranscriptItemClearText item;
+        item.box = Rect(Point(x0, y0), Point(x1, y1));
+        item.text = hocrPlainTextClearText(html, contentBegin, contentEnd);
+        if (!item.text.empty() && !item.box.empty()) {
+            items.push_back(item);
+        }
+        at = depth == 0 ? scan : contentBegin;
+    }
+}
+
+// Lines if the file has any, words otherwise.
+void parseHocrClearText(const string& html, vector<TranscriptItemClearText>& items) {
+    parseHocrElementsClearText(html, { "ocr_line", "ocr_header", "ocr_caption", "ocr_textfloat" }, items);
+    if (items.empty()) {
+        parseHocrElementsClearText(html, { "ocrx_word" }, items);
+    }
+}
+
+// Minimal recursive-descent JSON reader that keeps only what the import needs.
+// Any object with a "text" string and a box becomes an item: "bbox": [x0, y0,
+// x1, y1] as in hOCR, or "x"/"left", "y"/"top", "width"/"w", "height"/"h". An
+// item replaces the items found inside it, so a line with its words gives one
+// item. The layout around the objects (arrays, "pages", "blocks", ...) is free.
+struct TranscriptJsonReaderClearText {
+    const char* p;
+    const char* end;
+    vector<TranscriptItemClearText>& items;
+    int depth = 0;
+    static const int maxDepth = 256;
+
+    TranscriptJsonReaderClearText(const string& json, vector<TranscriptItemClearText>& out)
+        : p(json.data()), end(json.data() + json.size()), items(out) {}
+
+    void skipSpace() {
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if ((size_t)(end - p) < n || strncmp(p, word, n) != 0) {
+            return false;
+        }
+        p += n;
+        return true;
+    }
+
+    // Reads the 4 hex digits of a \u escape at `at`; false on a short or non-hex run.
+    bool hex4(const char* at, unsigned& value) const {
+        if (end - at < 4) {
+            return false;
+        }
+        value = 0;
+        for (int k = 0; k < 4; k++) {
+            int c = (unsigned char)at[k];
+            if (!isxdigit(c)) {
+                return false;
+            }
+            value = value * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+        }
+        return true;
+    }
+
+    bool readString(string& out) {
+        p++;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p >= end) {
+                return false;
+            }
+            char escape = *p++;
+            switch (escape) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': {
+                unsigned codePoint;
+                if (!hex4(p, codePoint)) {
+                    return false;
+                }
+                p += 4;
+                // A high surrogate only pairs with a following \uDC00-\uDFFF; a lone
+                // half becomes U+FFFD and the next escape is read on its own.
+                unsigned low;
+                if (codePoint >= 0xD800 && codePoint < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                    hex4(p + 2, low) && low >= 0xDC00 && low < 0xE000) {
+                    p += 6;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (codePoint >= 0xD800 && codePoint < 0xE000) {
+                    codePoint = 0xFFFD;
+                }
+                appendUtf8ClearText(out, codePoint);
+                break;
+            }
+            default: out += escape; break;
+            }
+        }
+        if (p >= end) {
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    // Parses one value; a string, number or array of numbers is also returned
+    // through text/number/numbers for the enclosing object.
+    bool readValue(string& text, double& number, vector<double>& numbers) {
+        skipSpace();
+        if (p >= end) {
+            return false;
+        }
+        if (*p == '"') {
+            return readString(text);
+        }
+        if (*p == '{' || *p == '[') {
+            // Bounded so a file of nested brackets fails instead of overflowing the stack.
+            if (depth >= maxDepth) {
+                return false;
+            }
+            depth++;
+            bool ok = *p == '{' ? readObject() : readArray(numbers);
+            depth--;
+            return ok;
+        }
+        if (literal("true") || literal("false") || literal("null")) {
+            return true;
+        }
+        char* numberEnd;
+        number = strtod(p, &numberEnd);
+        if (numberEnd == p) {
+            return false;
+        }
+        p = numberEnd;
+        return true;
+    }
+
+    bool readArray(vector<double>& numbers) {
+        p++;
+        skipSpace();
+        if (p < end && *p == ']') {
+            p++;
+            return true;
+        }
+        while (true) {
+            string itemText;
+            double itemNumber = NAN;
+            vector<double> itemNumbers;
+            if (!readValue(itemText, itemNumber, itemNumbers)) {
+                return false;
+            }
+            if (!std::isnan(itemNumber)) {
+                numbers.push_back(itemNumber);
+            }
+            skipSpace();
+            if (p < end && *p == ',') {
+                p++;
+                continue;
+            }
+            if (p < end && *p == ']') {
+                p++;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    bool readObject() {
+        p++;
+        size_t firstInside = items.size();
+        string text;
+        bool hasText = false;
+        vector<double> bbox;
+        double x = NAN, y = NAN, width = NAN, height = NAN;
+
+        skipSpace();
+        if (p < end && *p == '}') {
+            p++;
+            return true;
+        }
+        while (true) {
+            skipSpace();
+            string key;
+            if (p >= end || *p != '"' || !readString(key)) {
+                return false;
+            }
+            skipSpace();
+            if (p >= end || *p != ':') {
+                return false;
+            }
+            p++;
+
+            string memberText;
+            double memberNumber = NAN;
+            vector<double> memberNumbers;
+            if (!readValue(memberText, memberNumber, memberNumbers)) {
+                return false;
+            }
+            if (key == "text") {
+                text = memberText;
+                hasText = true;
+            }
+            else if (key == "bbox" || key == "box") {
+                bbox = memberNumbers;
+            }
+            else if (key == "x" || key == "left") {
+                x = memberNumber;
+            }
+            else if (key == "y" || key == "top") {
+                y = memberNumber;
+            }
+            else if (key == "width" || key == "w") {
+                width = memberNumber;
+            }
+            else if (key == "height" || key == "h") {
+                height = memberNumber;
+            }
+
+            skipSpace();
+            if (p < end && *p == ',') {
+                p++;
+                continue;
+            }
+            if (p < end && *p == '}') {
+                p++;
+                break;
+            }
+            return false;
+        }
+
+        Rect box;
+        if (bbox.size() == 4) {
+            box = Rect(Point(cvRound(bbox[0]), cvRound(bbox[1])), Point(cvRound(bbox[2]), cvRound(bbox[3])));
+        }
+        else if (!std::isnan(x) && !std::isnan(y) && !std::isnan(width) && !std::isnan(height)) {
+            box = Rect(cvRound(x), cvRound(y), cvRound(width), cvRound(height));
+        }
+        if (hasText && !box.empty()) {
+            items.resize(firstInside);
+            TranscriptItemClearText item;
+            item.box = box;
+            item.text = text;
+            items.push_back(item);
+        }
+        return true;
+    }
+
+    bool parse() {
+        string text;
+        double number;
+        vector<double> numbers;
+        if (!readValue(text, number, numbers)) {
+            return false;
+        }
+        skipSpace();
+        return p == end;
+    }
+};
+
+// Reads a .json transcription, or hOCR for any other extension (.hocr, .html).
+bool loadTranscriptClearText(const string& path, vector<TranscriptItemClearText>& items) {
+    items.clear();
+    MappedFileClearText file;
+    if (!file.open(path)) {
+        return false;
+    }
+    string contents((const char*)file.data, file.size);
+
+    size_t dot = path.find_last_of('.');
+    string ext = dot == string::npos ? "" : path.substr(dot + 1);
+    for (auto& c : ext) {
+        c = (char)tolower((unsigned char)c);
+    }
+    if (ext == "json") {
+        TranscriptJsonReaderClearText reader(contents, items);
+        return reader.parse();
+    }
+    parseHocrClearText(contents, items);
+    return true;
+}
+
+// <dir>/<image stem>.hocr, .html or .json, "" if there is none.
+string findTranscriptFileClearText(const string& dir, const string& imagePath) {
+    const char* extensions[] = { ".hocr", ".html", ".json" };
+    for (const char* ext : extensions) {
+        string path = dir + "/" + fileStemClearText(imagePath) + ext;
+        if (utils::fs::exists(path)) {
+            return path;
+        }
+    }
+    return "";
+}
+
+// Gives every item to the block its box overlaps most, if at least half of the
+// item lies inside that block, and joins each block's items in reading order
+// (lines from the top, an item starting a new line once its center is below the
+// first item of the current one; left to right within a line). Matched blocks
+// are marked validated. Returns the number of items that fell outside every block.
+size_t applyTranscriptClearText(const vector<TranscriptItemClearText>& items, vector<TextBlockClearText>& blocks) {
+    if (blocks.empty()) {
+        return items.size();
+    }
+
+    Rect bounds = blocks[0].boundingBox;
+    for (const auto& block : blocks) {
+        bounds |= block.boundingBox;
+    }
+    RectGridIndexClearText index;
+    index.reset(bounds, RectGridIndexClearText::suggestCellSize(bounds.size(), blocks.size()));
+    for (size_t b = 0; b < blocks.size(); b++) {
+        index.insert((int)b, blocks[b].boundingBox);
+    }
+
+    vector<vector<const TranscriptItemClearText*>> assigned(blocks.size());
+    size_t unmatched = 0;
+    for (const auto& item : items) {
+        int best = -1;
+        int bestArea = 0;
+        index.queryRect(item.box, [&](int b) {
+            int area = (blocks[b].boundingBox & item.box).area();
+            if (area > bestArea) {
+                best = b;
+                bestArea = area;
+            }
+        });
+        if (best < 0 || 2 * bestArea < item.box.area()) {
+            unmatched++;
+            continue;
+        }
+        assigned[best].push_back(&item);
+    }
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        auto& blockItems = assigned[b];
+        if (blockItems.empty()) {
+            continue;
+        }
+        sort(blockItems.begin(), blockItems.end(), [](const TranscriptItemClearText* a, const TranscriptItemClearText* c) {
+            return a->box.y + a->box.height / 2 < c->box.y + c->box.height / 2;
+        });
+
+        string text;
+        size_t lineStart = 0;
+        while (lineStart < blockItems.size()) {
+            const Rect& first = blockItems[lineStart]->box;
+            size_t lineEnd = lineStart + 1;
+            while (lineEnd < blockItems.size() &&
+                blockItems[lineEnd]->box.y + blockItems[lineEnd]->box.height / 2 < first.y + first.height) {
+                lineEnd++;
+            }
+            sort(blockItems.begin() + lineStart, blockItems.begin() + lineEnd,
+                [](const TranscriptItemClearText* a, const TranscriptItemClearText* c) { return a->box.x < c->box.x; });
+            for (size_t k = lineStart; k < lineEnd; k++) {
+                text += (text.empty() ? "" : " ") + blockItems[k]->text;
+            }
+            lineStart = lineEnd;
+        }
+
+        blocks[b].transcribedText = text;
+        blocks[b].isValidated = true;
+    }
+    return unmatched;
+}
+
+// The detection thresholds that change from one page type to another, with the
+// range the tuning mode offers. The keys are also the lines of the
+// cleartext.params files ("key value") read by the interactive modes.
+struct TunableParamClearText {
+    const char* key;
+    const char* label;
+    int DetectionParamsClearText::* field;
+    int minValue;
+    int maxValue;
+};
+
+const TunableParamClearText g_tunableParamsClearText[] = {
+    { "minComponentArea", "Arie min componenta", &DetectionParamsClearText::minComponentArea, 0, 500 },
+    { "maxComponentArea", "Arie max componenta", &DetectionParamsClearText::maxComponentArea, 100, 50000 },
+    { "maxComponentWidthDiv", "Latime max comp (1/n)", &DetectionParamsClearText::maxComponentWidthDiv, 1, 40 },
+    { "maxComponentHeightDiv", "Inaltime max comp (1/n)", &DetectionParamsClearText::maxComponentHeightDiv, 1, 80 },
+    { "dilationSize", "Dilatare", &DetectionParamsClearText::dilationSize, 1, 31 },
+    { "horizontalExtension", "Extindere orizontala", &DetectionParamsClearText::horizontalExtension, 0, 80 },
+    { "minBlockArea", "Arie min bloc", &DetectionParamsClearText::minBlockArea, 0, 20000 },
+};
+
+string detectionParamsPathClearText(const string& dir) {
+    return dir + "/cleartext.params";
+}
+
+bool writeDetectionParamsClearText(const string& path, const DetectionParamsClearText& params) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        return false;
+    }
+
+    for (const auto& tunable : g_tunableParamsClearText) {
+        fprintf(f, "%s %d\n", tunable.key, params.*tunable.field);
+    }
+    fclose(f);
+    return true;
+}
+
+// Unknown keys are skipped and values clamped to the tuning range. Returns
+// false if there is no such file.
+bool readDetectionParamsClearText(const string& path, DetectionParamsClearText& params) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == nullptr) {
+        return false;
+    }
+
+    char key[64];
+    int value;
+    while (fscanf(f, "%63s %d", key, &value) == 2) {
+        for (const auto& tunable : g_tunableParamsClearText) {
+            if (strcmp(key, tunable.key) == 0) {
+                params.*tunable.field = min(max(value, tunable.minValue), tunable.maxValue);
+            }
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// Peak resident set size of the process so far, 0 if unknown.
+size_t peakResidentBytesClearText() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+struct PageReportClearText {
+    size_t numBlocks = 0;
+    bool hasTranscript = false;
+    size_t transcribedBlocks = 0;
+    size_t unmatchedItems = 0;
+    string failedTranscript;
+    string failedSidecar;
+};
+
+// Fills the page's blocks from its transcription in g_transcriptDirClearText,
+// if there is one; the renderer then draws them like typed-in text.
+void importPageTranscriptClearText(const string& inputPath, vector<TextBlockClearText>& blocks,
+    PageReportClearText& report) {
+    if (g_transcriptDirClearText.empty()) {
+        return;
+    }
+    string transcriptPath = findTranscriptFileClearText(g_transcriptDirClearText, inputPath);
+    if (transcriptPath.empty()) {
+        return;
+    }
+    vector<TranscriptItemClearText> items;
+    if (!loadTranscriptClearText(transcriptPath, items)) {
+        report.failedTranscript = transcriptPath;
+        return;
+    }
+
+    TRACE_SCOPE_CLEARTEXT("transcript_import");
+    report.hasTranscript = true;
+    report.unmatchedItems = applyTranscriptClearText(items, blocks);
+    for (const auto& block : blocks) {
+        report.transcribedBlocks += block.isValidated ? 1 : 0;
+    }
+}
+
+bool processPageHeadlessClearText(const string& inputPath, const string& outputDir,
+    const DetectionParamsClearText& params, ScratchPoolClearText& scratch, PageReportClearText& report) {
+    scratch.reset();
+    string stem = outputDir + "/" + fileStemClearText(inputPath);
+    TRACE_PAGE_CLEARTEXT(stem + "_trace.json");
+    TRACE_SCOPE_CLEARTEXT("page");
+
+    PageClearText page;
+    {
+        TRACE_SCOPE_CLEARTEXT("load");
+        page.original = imread(inputPath, IMREAD_COLOR);
+    }
+    if (page.original.empty()) {
+        return false;
+    }
 
-        int newWidth = (int)(img.cols * scale);
-        int newHeight = (int)(img.rows * scale);
+    Mat result;
+    if (g_memoryBudgetClearText > 0) {
+        int T = detectTextBlocksTiledClearText(page.original, params, g_memoryBudgetClearText, page.blocks);
+        importPageTranscriptClearText(inputPath, page.blocks, report);
+        inpaintTiledClearText(page.original, T, params, page.blocks);
+        renderTranscriptionsClearText(page.original, page.blocks);
+        result = page.original;
+    }
+    else {
+        string sidecarPath = sidecarPathClearText(inputPath);
+        SidecarSourceClearText source = g_useSidecarsClearText ? sidecarSourceClearText(inputPath) : SidecarSourceClearText();
+        uint64 paramsHash = paramsHashClearText(params);
+        if (!g_useSidecarsClearText || !loadPageSidecarClearText(sidecarPath, source, paramsHash, page)) {
+            detectTextBlocksClearText(page, params, &scratch);
+            if (g_useSidecarsClearText && !writePageSidecarClearText(sidecarPath, page, source, paramsHash)) {
+                report.failedSidecar = sidecarPath;
+            }
+        }
+        importPageTranscriptClearText(inputPath, page.blocks, report);
 
-        resize(img, resized, Size(newWidth, newHeight), 0, 0, INTER_AREA);
-        return resized;
+        Mat backgroundOnly;
+        reconstructPageClearText(page, backgroundOnly, result, &scratch);
     }
 
-    return img.clone();
+    report.numBlocks = page.blocks.size();
+    TRACE_SCOPE_CLEARTEXT("save");
+    return imwrite(stem + "_clean.png", result) &&
+        writeBlocksFileClearText(stem + "_blocks.txt", page.blocks);
 }
 
-Mat grayscale_to_BW_autoClearText(Mat src) {
-    Mat dst(src.rows, src.cols, CV_8UC1);
+vector<string> listImageFilesClearText(const string& dir) {
+    vector<String> candidates;
+    glob(dir + "/*", candidates, false);
 
-    int hist[256] = { 0 };
-    for (int i = 0; i < src.rows; i++) {
-        for (int j = 0; j < src.cols; j++) {
-            hist[src.at<uchar>(i, j)]++;
+    vector<string> files;
+    for (const auto& path : candidates) {
+        if (isImageFileClearText(path)) {
+            files.push_back(path);
         }
     }
+    sort(files.begin(), files.end());
+    return files;
+}
 
-    int T = 128;
-    int T_prev = 0;
-    float error = 0.1f;
-
-    while (abs(T - T_prev) >= error) {
-        T_prev = T;
-        int count1 = 0, count2 = 0;
-        int sum1 = 0, sum2 = 0;
+// Every page is a task of the shared pool, so the band tasks of a large page
+// spread over the workers left idle by small ones. Scratch pools are not tied to
+// a thread: whichever worker starts a page takes one from a free list and
+// returns it when the page is done.
+int runBatchClearText(const string& inputDir, const string& outputDir, const DetectionParamsClearText& params) {
+    vector<string> files = listImageFilesClearText(inputDir);
+    if (files.empty()) {
+        printf("Nu am gasit imagini in %s\n", inputDir.c_str());
+        return 1;
+    }
+    if (!utils::fs::createDirectories(outputDir)) {
+        printf("Nu am putut crea directorul de iesire: %s\n", outputDir.c_str());
+        return 1;
+    }
 
-        for (int i = 0; i < 256; i++) {
-            if (i <= T) {
-                count1 += hist[i];
-                sum1 += i * hist[i];
-            }
-            else {
-                count2 += hist[i];
-                sum2 += i * hist[i];
+    WorkStealingPoolClearText& pool = taskPoolClearText();
+    g_verboseClearText = false;
+
+    printf("Procesare batch: %zu pagini, %d fire de executie, kernel-uri %s\n", files.size(), pool.size(),
+        g_kernelsClearText->name);
+
+    atomic<size_t> donePages(0);
+    atomic<size_t> failedPages(0);
+    atomic<size_t> transcribedPages(0);
+    atomic<size_t> transcribedBlocks(0);
+    atomic<size_t> unmatchedItems(0);
+    atomic<size_t> failedTranscripts(0);
+    mutex outputMutex;
+    mutex scratchMutex;
+    vector<unique_ptr<ScratchPoolClearText>> scratchPools;
+    vector<ScratchPoolClearText*> freeScratch;
+    int64 batchStart = getTickCount();
+    pool.resetCounters();
+
+    auto processPage = [&](size_t index) {
+        ScratchPoolClearText* scratch;
+        {
+            lock_guard<mutex> lock(scratchMutex);
+            if (freeScratch.empty()) {
+                scratchPools.push_back(make_unique<ScratchPoolClearText>());
+                freeScratch.push_back(scratchPools.back().get());
             }
+            scratch = freeScratch.back();
+            freeScratch.pop_back();
         }
 
-        float mean1;
-        if (count1 > 0) {
-            mean1 = (float)sum1 / count1;
+        int64 pageStart = getTickCount();
+        PageReportClearText report;
+        bool ok = processPageHeadlessClearText(files[index], outputDir, params, *scratch, report);
+        int64 pageEnd = getTickCount();
+        {
+            lock_guard<mutex> lock(scratchMutex);
+            freeScratch.push_back(scratch);
         }
-        else {
-            mean1 = 0;
+
+        size_t done = ++donePages;
+        if (!ok) {
+            failedPages++;
+        }
+        if (report.hasTranscript) {
+            transcribedPages++;
+            transcribedBlocks += report.transcribedBlocks;
+            unmatchedItems += report.unmatchedItems;
+        }
+        if (!report.failedTranscript.empty()) {
+            failedTranscripts++;
         }
 
-        float mean2;
-        if (count2 > 0) {
-            mean2 = (float)sum2 / count2;
+        double pageSeconds = (pageEnd - pageStart) / getTickFrequency();
+        double totalSeconds = (pageEnd - batchStart) / getTickFrequency();
+
+        lock_guard<mutex> lock(outputMutex);
+        if (!report.failedTranscript.empty()) {
+            printf("[%zu/%zu] %s: EROARE la citirea transcrierii %s, pagina fara text\n", done, files.size(),
+                fileNameClearText(files[index]).c_str(), report.failedTranscript.c_str());
+        }
+        if (!report.failedSidecar.empty()) {
+            printf("[%zu/%zu] %s: nu am putut salva %s\n", done, files.size(),
+                fileNameClearText(files[index]).c_str(), report.failedSidecar.c_str());
+        }
+        if (ok && report.hasTranscript) {
+            printf("[%zu/%zu] %s: %zu blocuri (%zu transcrise, %zu fragmente fara bloc), %.2f s (%.2f pagini/s)\n",
+                done, files.size(), fileNameClearText(files[index]).c_str(), report.numBlocks,
+                report.transcribedBlocks, report.unmatchedItems, pageSeconds, done / totalSeconds);
+        }
+        else if (ok) {
+            printf("[%zu/%zu] %s: %zu blocuri, %.2f s (%.2f pagini/s)\n", done, files.size(),
+                fileNameClearText(files[index]).c_str(), report.numBlocks, pageSeconds, done / totalSeconds);
         }
         else {
-            mean2 = 0;
+            printf("[%zu/%zu] %s: EROARE la procesare\n", done, files.size(),
+                fileNameClearText(files[index]).c_str());
         }
+        fflush(stdout);
+    };
 
-        T = (int)((mean1 + mean2) / 2);
+    TaskGroupClearText pages;
+    for (size_t index = 0; index < files.size(); index++) {
+        pool.submit(pages, [&processPage, index]() { processPage(index); });
     }
+    pool.wait(pages);
 
-    printf("Prag calculat automat: %d\n", T);
+    size_t scratchBytes = 0;
+    size_t scratchAllocations = 0;
+    for (const auto& scratch : scratchPools) {
+        scratchBytes += scratch->reservedBytes;
+        scratchAllocations += scratch->allocations;
+    }
 
-    for (int i = 0; i < src.rows; i++) {
-        for (int j = 0; j < src.cols; j++) {
-            if (src.at<uchar>(i, j) < T) {
-                dst.at<uchar>(i, j) = 0;
-            }
-            else {
-                dst.at<uchar>(i, j) = 255;
-            }
-        }
+    double totalSeconds = (getTickCount() - batchStart) / getTickFrequency();
+    printf("Batch complet: %zu pagini in %.2f s (%.2f pagini/s), %zu erori\n",
+        files.size(), totalSeconds, files.size() / totalSeconds, (size_t)failedPages);
+    if (!g_transcriptDirClearText.empty()) {
+        printf("Transcrieri importate: %zu pagini, %zu blocuri transcrise, %zu fragmente fara bloc, %zu fisiere invalide\n",
+            (size_t)transcribedPages, (size_t)transcribedBlocks, (size_t)unmatchedItems, (size_t)failedTranscripts);
     }
+    printf("Memorie: varf rezident %.1f MB, buffere de lucru %.1f MB (%zu alocari pentru %zu pagini)\n",
+        peakResidentBytesClearText() / 1048576.0, scratchBytes / 1048576.0, scratchAllocations, files.size());
+    printf("Utilizare fire:\n");
+    pool.printUtilization();
 
-    return dst;
+    g_verboseClearText = true;
+    return failedPages > 0 || failedTranscripts > 0 ? 1 : 0;
 }
 
-Mat dilateCustomClearText(Mat src, int structSize = 5) {
-    Mat dst = src.clone();
-    int half = structSize / 2;
-
-    for (int i = half; i < src.rows - half; i++) {
-        for (int j = half; j < src.cols - half; j++) {
-            if (src.at<uchar>(i, j) == 0) {
-                for (int di = -half; di <= half; di++) {
-                    for (int dj = -half; dj <= half; dj++) {
-                        int ni = i + di;
-                        int nj = j + dj;
+// Synthetic scanned page for benchmarking: paragraphs of random words in one
+// or two columns, yellowish paper with uneven illumination (vignetting and a
+// shadow towards the spine), gaussian sensor noise and dark speckle. The same
+// seed always gives the same page.
+Mat generateSyntheticPageClearText(Size size, int dpi, uint64 seed) {
+    RNG rng(seed);
+    Mat page(size, CV_8UC3, Scalar(222, 236, 244));
+
+    double fontScale = 0.097 * dpi / 22.0;
+    int thickness = max(1, cvRound(fontScale * 1.6));
+    int lineHeight = cvRound(dpi * 14.0 / 72.0);
+    int marginX = size.width / 12;
+    int marginY = size.height / 14;
+    int numColumns = rng.uniform(1, 3);
+    int gutter = dpi / 4;
+    int columnWidth = (size.width - 2 * marginX - (numColumns - 1) * gutter) / numColumns;
+
+    for (int c = 0; c < numColumns; c++) {
+        int x0 = marginX + c * (columnWidth + gutter);
+        int y = marginY + lineHeight;
+
+        while (y < size.height - marginY) {
+            bool heading = rng.uniform(0, 8) == 0;
+            double scale = heading ? fontScale * 1.6 : fontScale;
+            int step = heading ? lineHeight * 2 : lineHeight;
+            int numLines = heading ? 1 : rng.uniform(3, 14);
+            Scalar ink(rng.uniform(20, 70), rng.uniform(20, 60), rng.uniform(20, 60));
+
+            for (int l = 0; l < numLines && y < size.height - marginY; l++) {
+                int x = x0 + (l == 0 && !heading ? lineHeight : 0);
+                int lineEnd = x0 + (l == numLines - 1 ? rng.uniform(columnWidth / 3, columnWidth) : columnWidth);
+
+                while (true) {
+                    string word;
+                    int length = rng.uniform(1, 10);
+                    for (int k = 0; k < length; k++) {
+                        word += (char)((k == 0 && rng.uniform(0, 6) == 0 ? 'A' : 'a') + rng.uniform(0, 26));
+                    }
 
-                        if (ni >= 0 && ni < dst.rows && nj >= 0 && nj < dst.cols) {
-                            dst.at<uchar>(ni, nj) = 0;
-                        }
+                    int wordWidth = getTextSize(word, FONT_HERSHEY_SIMPLEX, scale, thickness, nullptr).width;
+                    if (x + wordWidth > lineEnd) {
+                        break;
                     }
+                    putText(page, word, Point(x, y), FONT_HERSHEY_SIMPLEX, scale, ink, thickness);
+                    x += wordWidth + cvRound(lineHeight * 0.35);
                 }
+                y += step;
             }
+            y += lineHeight * rng.uniform(1, 3);
         }
     }
 
-    return dst;
+    int numSpeckles = (int)((int64)size.width * size.height / (dpi * 40));
+    int maxRadius = max(1, dpi / 150);
+    for (int k = 0; k < numSpeckles; k++) {
+        Point center(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        int gray = rng.uniform(0, 90);
+        circle(page, center, rng.uniform(0, maxRadius + 1), Scalar(gray, gray, gray), -1);
+    }
+
+    vector<float> columnLight(size.width), rowLight(size.height);
+    double spine = rng.uniform(0.03, 0.08) * size.width;
+    for (int j = 0; j < size.width; j++) {
+        double dx = (double)j / size.width - 0.5;
+        columnLight[j] = (float)((1.0 - 0.35 * dx * dx) * (1.0 - 0.3 * exp(-j / spine)));
+    }
+    for (int i = 0; i < size.height; i++) {
+        double dy = (double)i / size.height - 0.5;
+        rowLight[i] = (float)(1.0 - 0.25 * dy * dy - 0.08 * i / size.height);
+    }
+
+    for (int i = 0; i < size.height; i++) {
+        uchar* pageRow = page.ptr<uchar>(i);
+        for (int j = 0; j < size.width; j++) {
+            float light = rowLight[i] * columnLight[j];
+            float noise = (float)rng.gaussian(6.0);
+            for (int ch = 0; ch < 3; ch++) {
+                pageRow[3 * j + ch] = saturate_cast<uchar>(pageRow[3 * j + ch] * light + noise);
+            }
+        }
+    }
+
+    return page;
 }
 
-int labelConnectedComponentsClearText(Mat img, Mat& labels, vector<Rect>& boundingBoxes) {
-    int height = img.rows;
-    int width = img.cols;
-    int nr = 0;
+uint64 imageChecksumClearText(const Mat& img) {
+    uint64 hash = 14695981039346656037ULL;
+    for (int i = 0; i < img.rows; i++) {
+        hash = fnv1aClearText(img.ptr<uchar>(i), img.cols * img.elemSize(), hash);
+    }
+    return hash;
+}
 
-    labels = Mat::zeros(height, width, CV_32SC1);
-    boundingBoxes.clear();
+struct BenchPageFormatClearText {
+    const char* name;
+    double widthMm;
+    double heightMm;
+    int dpi;
+};
 
-    int di[] = { -1, -1, 0, 1, 1, 1, 0, -1 };
-    int dj[] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+// A5 at 150 dpi up to A3 at 600 dpi.
+static const BenchPageFormatClearText g_benchFormatsClearText[] = {
+    { "A5", 148, 210, 150 },
+    { "A5", 148, 210, 300 },
+    { "A4", 210, 297, 300 },
+    { "A4", 210, 297, 600 },
+    { "A3", 297, 420, 300 },
+    { "A3", 297, 420, 600 },
+};
 
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            if (img.at<uchar>(i, j) == 0 && labels.at<int>(i, j) == 0) {
-                nr++;
-                queue<Point> Q;
-                labels.at<int>(i, j) = nr;
-                Q.push(Point(j, i));
+Size benchPageSizeClearText(const BenchPageFormatClearText& format) {
+    return Size(cvRound(format.widthMm / 25.4 * format.dpi), cvRound(format.heightMm / 25.4 * format.dpi));
+}
 
-                int minX = j, maxX = j, minY = i, maxY = i;
+struct BenchStageResultClearText {
+    double minMs;
+    double medianMs;
+};
 
-                while (!Q.empty()) {
-                    Point q = Q.front();
-                    Q.pop();
-                    int qi = q.y;
-                    int qj = q.x;
+BenchStageResultClearText benchStageClearText(int repeats, const function<void()>& setup,
+    const function<void()>& run) {
+    vector<double> times;
+    for (int r = 0; r < repeats; r++) {
+        if (setup) {
+            setup();
+        }
+        int64 start = getTickCount();
+        run();
+        times.push_back((getTickCount() - start) * 1000.0 / getTickFrequency());
+    }
+    sort(times.begin(), times.end());
 
-                    if (qj < minX) minX = qj;
-                    if (qj > maxX) maxX = qj;
-                    if (qi < minY) minY = qi;
-                    if (qi > maxY) maxY = qi;
+    BenchStageResultClearText result;
+    result.minMs = times.front();
+    result.medianMs = times[times.size() / 2];
+    return result;
+}
 
-                    for (int k = 0; k < 8; k++) {
-                        int ni = qi + di[k];
-                        int nj = qj + dj[k];
+// Headless benchmark of every pipeline stage on synthetic pages from A5 at
+// 150 dpi up to A3 at 600 dpi. Each stage runs `repeats` times on the output
+// of the previous one; the CSV has the best and median time per stage plus a
+// deterministic result (a count or an FNV-1a checksum of the output), so two runs
+// can be diffed for both speed and behaviour.
+int runBenchmarkClearText(const string& outputPath, int repeats, bool withReference,
+    const DetectionParamsClearText& params) {
+    FILE* out = stdout;
+    if (!outputPath.empty()) {
+        out = fopen(outputPath.c_str(), "w");
+        if (!out) {
+            printf("Nu am putut deschide fisierul: %s\n", outputPath.c_str());
+            return 1;
+        }
+    }
 
-                        if (ni >= 0 && ni < height && nj >= 0 && nj < width) {
-                            if (img.at<uchar>(ni, nj) == 0 && labels.at<int>(ni, nj) == 0) {
-                                labels.at<int>(ni, nj) = nr;
-                                Q.push(Point(nj, ni));
-                            }
-                        }
-                    }
-                }
+    repeats = max(1, repeats);
+    g_verboseClearText = false;
+    // Load the glyph atlas up front so the first page's rendering does not pay for it.
+    glyphAtlasClearText();
+
+    fprintf(out, "page,dpi,width,height,threads,kernels,stage,runs,min_ms,median_ms,mpix_per_s,result\n");
+
+    for (const auto& format : g_benchFormatsClearText) {
+        Size size = benchPageSizeClearText(format);
+        PageClearText page;
+        page.original = generateSyntheticPageClearText(size, format.dpi, 0x5eed0000 + format.dpi);
+        double megapixels = (double)size.area() / 1e6;
+
+        auto report = [&](const char* stage, const BenchStageResultClearText& r, uint64 value) {
+            fprintf(out, "%s,%d,%d,%d,%d,%s,%s,%d,%.3f,%.3f,%.2f,%llu\n", format.name, format.dpi,
+                size.width, size.height, taskPoolClearText().size(), g_kernelsClearText->name, stage, repeats,
+                r.minMs, r.medianMs,
+                megapixels / (r.minMs / 1000.0), (unsigned long long)value);
+            fflush(out);
+        };
+
+        if (out != stdout) {
+            printf("%s @ %d dpi (%dx%d)...\n", format.name, format.dpi, size.width, size.height);
+            fflush(stdout);
+        }
 
-                Rect bbox(minX, minY, maxX - minX + 1, maxY - minY + 1);
-                boundingBoxes.push_back(bbox);
+        BenchStageResultClearText timing;
+        int hist[256];
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            grayscaleHistogramClearText(page.original, page.gray, hist);
+        });
+        report("grayscale", timing, imageChecksumClearText(page.gray));
+
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            binarizeGrayClearText(page.gray, hist, params, page.binary);
+        });
+        report("threshold", timing, imageChecksumClearText(page.binary));
+
+        Mat labels;
+        vector<Rect> boundingBoxes;
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            labelComponentsUnionFindClearText(page.binary, labels, boundingBoxes, nullptr, 0, params.connectivity);
+        });
+        report("labeling", timing, boundingBoxes.size());
+
+        // Bit-packed stages are checksummed on their unpacked image, so the
+        // values stay comparable with the byte-per-pixel implementation.
+        Mat unpacked;
+        BitplaneClearText painted;
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            paintTextComponentsBitsClearText(labels, boundingBoxes, size, params, painted);
+        });
+        unpackBinaryClearText(painted, unpacked);
+        report("component_filter", timing, imageChecksumClearText(unpacked));
+
+        BitplaneClearText dilatedBits = painted;
+        timing = benchStageClearText(repeats, [&]() { dilatedBits.words = painted.words.clone(); }, [&]() {
+            dilateBitsClearText(dilatedBits, blockKernelClearText(params));
+            unpackBinaryClearText(dilatedBits, page.dilated);
+        });
+        report("dilation", timing, imageChecksumClearText(page.dilated));
+
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            extractTextBlocksBitsClearText(dilatedBits, params, page.blocks);
+        });
+        report("block_extraction", timing, page.blocks.size());
+
+        vector<TextBlockClearText> clusteredBlocks;
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            clusterTextBlocksClearText(boundingBoxes, size, params, clusteredBlocks);
+        });
+        report("block_clustering", timing, clusteredBlocks.size());
+
+        DetectionParamsClearText pyramidParams = params;
+        pyramidParams.pyramidFactor = format.dpi >= 600 ? 4 : 2;
+        vector<TextBlockClearText> pyramidBlocks;
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            detectTextBlocksCoarseToFineClearText(page.binary, pyramidParams, pyramidBlocks);
+        });
+        report("coarse_to_fine", timing, pyramidBlocks.size());
+
+        BitplaneClearText mask;
+        timing = benchStageClearText(repeats, nullptr, [&]() {
+            buildTextMaskClearText(page.binary, page.blocks, mask);
+        });
+        Mat maskImage;
+        unpackBinaryClearText(mask, maskImage);
+        report("mask_build", timing, imageChecksumClearText(maskImage));
+
+        Mat background;
+        timing = benchStageClearText(repeats, [&]() { page.original.copyTo(background); }, [&]() {
+            inpaintFrontierClearText(background, mask, page.blocks);
+        });
+        report("inpainting", timing, imageChecksumClearText(background));
+
+        Mat modelBackground;
+        timing = benchStageClearText(repeats, [&]() { page.original.copyTo(modelBackground); }, [&]() {
+            inpaintBackgroundModelClearText(modelBackground, mask, backgroundModelFactorClearText(size));
+        });
+        report("background_model", timing, imageChecksumClearText(modelBackground));
+
+        RNG rng(format.dpi);
+        for (auto& block : page.blocks) {
+            block.transcribedText.clear();
+            int numWords = max(1, block.boundingBox.width / 60);
+            for (int w = 0; w < numWords; w++) {
+                block.transcribedText += string(rng.uniform(2, 9), (char)('a' + rng.uniform(0, 26))) + " ";
             }
+            block.isValidated = true;
+        }
+        Mat rendered;
+        timing = benchStageClearText(repeats, [&]() { background.copyTo(rendered); }, [&]() {
+            renderTranscriptionsClearText(rendered, page.blocks);
+        });
+        report("text_rendering", timing, imageChecksumClearText(rendered));
+
+        if (withReference) {
+            Mat referenceGray;
+            timing = benchStageClearText(repeats, nullptr, [&]() {
+                grayscaleClearText(page.original, referenceGray);
+            });
+            report("grayscale_reference", timing, imageChecksumClearText(referenceGray));
+
+            Mat referenceBinary;
+            timing = benchStageClearText(repeats, nullptr, [&]() {
+                referenceBinary = grayscale_to_BW_autoClearText(referenceGray);
+            });
+            report("threshold_reference", timing, imageChecksumClearText(referenceBinary));
+
+            vector<Rect> referenceBoxes;
+            timing = benchStageClearText(repeats, nullptr, [&]() {
+                labelConnectedComponentsClearText(page.binary, labels, referenceBoxes, params.connectivity);
+            });
+            report("labeling_reference", timing, referenceBoxes.size());
+
+            Mat referenceBackground;
+            timing = benchStageClearText(repeats, nullptr, [&]() {
+                referenceBackground = simpleInpaintingClearText(page.original, maskImage);
+            });
+            report("inpainting_reference", timing, imageChecksumClearText(referenceBackground));
+
+            timing = benchStageClearText(repeats, [&]() { background.copyTo(rendered); }, [&]() {
+                renderTranscriptionsHersheyClearText(rendered, page.blocks);
+            });
+            report("text_rendering_reference", timing, imageChecksumClearText(rendered));
         }
     }
 
-    return nr;
+    if (out != stdout) {
+        fclose(out);
+        printf("Rezultate salvate in %s\n", outputPath.c_str());
+    }
+    g_verboseClearText = true;
+    return 0;
 }
 
-Mat simpleInpaintingClearText(Mat original, Mat mask) {
-    Mat result = original.clone();
+// Output of every stage that goes through the row kernels, as FNV-1a checksums:
+// the kernels themselves, then detection and both reconstructions end to end.
+vector<pair<const char*, uint64>> kernelStageChecksumsClearText(const Mat& original, const DetectionParamsClearText& params) {
+    vector<pair<const char*, uint64>> stages;
+    PageClearText page;
+    page.original = original;
+
+    int hist[256];
+    grayscaleHistogramClearText(page.original, page.gray, hist);
+    stages.emplace_back("grayscale", fnv1aClearText(hist, sizeof(hist), imageChecksumClearText(page.gray)));
+
+    thresholdBinaryClearText(page.gray, page.binary, computeAutoThresholdClearText(hist));
+    stages.emplace_back("threshold", imageChecksumClearText(page.binary));
+
+    BitplaneClearText bits;
+    packBinaryClearText(page.binary, bits);
+    stages.emplace_back("bitplane", imageChecksumClearText(bits.words));
+
+    // The gray page covers packing of values other than 0 and 255.
+    BitplaneClearText grayBits;
+    packBinaryClearText(page.gray, grayBits);
+    stages.emplace_back("bitplane_gray", imageChecksumClearText(grayBits.words));
+
+    dilateBitsClearText(bits, blockKernelClearText(params));
+    stages.emplace_back("dilation_bits", imageChecksumClearText(bits.words));
+
+    Mat morph;
+    dilateRectClearText(page.binary, morph, blockKernelClearText(params));
+    erodeRectClearText(morph, morph, Size(3, 3));
+    stages.emplace_back("dilation_bytes", imageChecksumClearText(morph));
+
+    detectTextBlocksClearText(page, params);
+    uint64 blocksHash = fnv1aClearText(nullptr, 0);
+    for (const auto& block : page.blocks) {
+        blocksHash = fnv1aClearText(&block.boundingBox, sizeof(Rect), blocksHash);
+    }
+    stages.emplace_back("detect", blocksHash);
 
-    for (int iter = 0; iter < 10; iter++) {
-        Mat temp = result.clone();
+    BitplaneClearText mask;
+    buildTextMaskClearText(page.binary, page.blocks, mask);
+    stages.emplace_back("mask_build", imageChecksumClearText(mask.words));
 
-        for (int i = 1; i < mask.rows - 1; i++) {
-            for (int j = 1; j < mask.cols - 1; j++) {
-                if (mask.at<uchar>(i, j) == 0) {
-                    int count = 0;
-                    Vec3f sum(0, 0, 0);
+    Mat background = original.clone();
+    inpaintFrontierClearText(background, mask, page.blocks);
+    stages.emplace_back("inpainting", imageChecksumClearText(background));
+
+    original.copyTo(background);
+    inpaintBackgroundModelClearText(background, mask, backgroundModelFactorClearText(original.size()));
+    stages.emplace_back("background_model", imageChecksumClearText(background));
+    return stages;
+}
 
-                    for (int di = -1; di <= 1; di++) {
-                        for (int dj = -1; dj <= 1; dj++) {
-                            if (di == 0 && dj == 0) continue;
+// Runs every stage with each kernel set the CPU supports and compares the
+// checksums with the scalar reference, on the benchmark's synthetic pages or on
+// the images of inputDir. Returns 1 if any stage differs.
+int verifyKernelsClearText(const string& inputDir, const DetectionParamsClearText& params) {
+    vector<pair<string, Mat>> pages;
+    if (inputDir.empty()) {
+        for (const auto& format : g_benchFormatsClearText) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s @ %d dpi", format.name, format.dpi);
+            pages.emplace_back(name, generateSyntheticPageClearText(benchPageSizeClearText(format), format.dpi,
+                0x5eed0000 + format.dpi));
+        }
+    }
+    else {
+        for (const auto& path : listImageFilesClearText(inputDir)) {
+            Mat image = imread(path, IMREAD_COLOR);
+            if (!image.empty()) {
+                pages.emplace_back(fileNameClearText(path), image);
+            }
+        }
+        if (pages.empty()) {
+            printf("Nu am gasit imagini in %s\n", inputDir.c_str());
+            return 1;
+        }
+    }
 
-                            int ni = i + di;
-                            int nj = j + dj;
+    const KernelSetClearText* selected = g_kernelsClearText;
+    g_verboseClearText = false;
+    int compared = 0, mismatches = 0;
 
-                            if (mask.at<uchar>(ni, nj) == 255) {
-                                Vec3b pixel = result.at<Vec3b>(ni, nj);
-                                sum[0] += pixel[0];
-                                sum[1] += pixel[1];
-                                sum[2] += pixel[2];
-                                count++;
-                            }
-                        }
-                    }
+    for (const auto& page : pages) {
+        g_kernelsClearText = &g_kernelSetsClearText[0];
+        auto reference = kernelStageChecksumsClearText(page.second, params);
 
-                    if (count > 0) {
-                        temp.at<Vec3b>(i, j) = Vec3b(
-                            (uchar)(sum[0] / count),
-                            (uchar)(sum[1] / count),
-                            (uchar)(sum[2] / count)
-                        );
-                    }
+        for (const auto& set : g_kernelSetsClearText) {
+            if (&set == &g_kernelSetsClearText[0]) {
+                continue;
+            }
+            if (!kernelSetSupportedClearText(set)) {
+                printf("%s: %s nu este suportat de acest procesor\n", page.first.c_str(), set.name);
+                continue;
+            }
+            g_kernelsClearText = &set;
+            auto stages = kernelStageChecksumsClearText(page.second, params);
+
+            int pageMismatches = 0;
+            for (size_t s = 0; s < stages.size(); s++) {
+                compared++;
+                if (stages[s].second != reference[s].second) {
+                    pageMismatches++;
+                    printf("  DIFERIT %s / %s / %s: %016llx, scalar %016llx\n", page.first.c_str(), set.name,
+                        stages[s].first, (unsigned long long)stages[s].second,
+                        (unsigned long long)reference[s].second);
                 }
             }
+            mismatches += pageMismatches;
+            printf("%s: %s %zu/%zu etape identice cu scalar\n", page.first.c_str(), set.name,
+                stages.size() - pageMismatches, stages.size());
         }
-        result = temp;
     }
 
-    return result;
+    g_kernelsClearText = selected;
+    g_verboseClearText = true;
+    printf("Verificare kernel-uri: %d comparatii, %d diferente (activ: %s)\n", compared, mismatches, selected->name);
+    return mismatches > 0 ? 1 : 0;
 }
 
 void onMouseCallbackClearText(int event, int x, int y, int flags, void* userdata) {
 
-    if (event == EVENT_LBUTTONDOWN && g_textBlocksClearText != nullptr) {
+    if (event == EVENT_LBUTTONDOWN && g_blockStoreClearText != nullptr) {
 
         Point originalPoint((int)(x / g_displayScaleClearText), (int)(y / g_displayScaleClearText));
 
         int oldSelected = g_selectedBlockClearText;
-        g_selectedBlockClearText = -1;
-
-        for (size_t i = 0; i < g_textBlocksClearText->size(); i++) {
-            Rect block = (*g_textBlocksClearText)[i].boundingBox;
-
-            if (block.contains(originalPoint)) {
-                g_selectedBlockClearText = (int)i;
-                break;
-            }
-        }
+        g_selectedBlockClearText = g_blockStoreClearText->hitTest(originalPoint);
 
         if (oldSelected != g_selectedBlockClearText) {
             g_needsUpdateClearText = true;
@@ -268,215 +5857,290 @@ void onMouseCallbackClearText(int event, int x, int y, int flags, void* userdata
     }
 }
 
-void testClearTextWithMouseSelection() {
-
-    char fname[MAX_PATH];
-    if (!openFileDlg(fname)) {
-        printf("Nu a fost selectata nicio imagine.\n");
-        return;
+// Layered display for the transcription window: `base` is the resized page,
+// `overlay` caches base plus every block decoration and `frame` is overlay plus
+// the HUD. Selecting, transcribing or deleting a block repaints only the
+// decoration rectangles involved, found through a grid over the decorations, so
+// an update costs about the same with ten blocks or with thousands.
+struct BlockOverlayRendererClearText {
+    Mat base;
+    Mat overlay;
+    Mat frame;
+    double scale = 1.0;
+    const TextBlockStoreClearText* store = nullptr;
+    vector<Rect> decorations;
+    RectGridIndexClearText decorationGrid;
+    int selected = -1;
+
+    void reset(const Mat& display, double displayScale, const TextBlockStoreClearText& blockStore) {
+        base = display;
+        scale = displayScale;
+        store = &blockStore;
+        selected = -1;
+
+        decorations.assign(blockStore.idLimit(), Rect());
+        decorationGrid.reset(Rect(0, 0, display.cols, display.rows),
+            RectGridIndexClearText::suggestCellSize(display.size(), blockStore.size()));
+        base.copyTo(overlay);
+        for (int id = 0; id < blockStore.idLimit(); id++) {
+            if (blockStore.find(id)) {
+                decorations[id] = decorationRect(id);
+                decorationGrid.insert(id, decorations[id]);
+                drawBlock(overlay, Point(0, 0), id);
+            }
+        }
+        overlay.copyTo(frame);
     }
 
-    Mat originalImage = imread(fname, IMREAD_COLOR);
-    if (originalImage.empty()) {
-        printf("Nu am putut incarca imaginea: %s\n", fname);
-        return;
+    Rect displayRect(int id) const {
+        const Rect& box = store->find(id)->boundingBox;
+        return Rect((int)(box.x * scale), (int)(box.y * scale), (int)(box.width * scale), (int)(box.height * scale));
     }
 
-    printf("\n=== DETECTIA BLOCURILOR DE TEXT ===\n");
-
-    Mat grayImage(originalImage.rows, originalImage.cols, CV_8UC1);
-    for (int i = 0; i < originalImage.rows; i++) {
-        for (int j = 0; j < originalImage.cols; j++) {
-            Vec3b pixel = originalImage.at<Vec3b>(i, j);
-            uchar gray = (pixel[0] + pixel[1] + pixel[2]) / 3;
-            grayImage.at<uchar>(i, j) = gray;
+    string preview(int id) const {
+        const TextBlockClearText& block = *store->find(id);
+        if (!block.isValidated || block.transcribedText.empty()) {
+            return "";
         }
+        string text = block.transcribedText.substr(0, 15);
+        if (block.transcribedText.length() > 15) text += "...";
+        return text;
     }
 
-    Mat binaryImage = grayscale_to_BW_autoClearText(grayImage);
+    // Everything drawBlock can touch for the block, for either selection state.
+    Rect decorationRect(int id) const {
+        Rect r = displayRect(id);
+        int pad = max(4, (int)(4 * scale)) / 2 + 2;
+        Rect area(r.x - pad, r.y - pad, r.width + 2 * pad, r.height + 2 * pad);
+
+        int baseline = 0;
+        int labelThickness = max(1, (int)(2 * scale));
+        Size label = getTextSize(to_string(id + 1), FONT_HERSHEY_SIMPLEX, 0.6 * scale, labelThickness, &baseline);
+        area |= Rect(r.x - labelThickness - 2, r.y - 5 - label.height - labelThickness - 2,
+            label.width + 2 * labelThickness + 4, label.height + baseline + 2 * labelThickness + 4);
+
+        string text = preview(id);
+        if (!text.empty()) {
+            int previewThickness = max(1, (int)(1 * scale));
+            int y = r.y + r.height + (int)(15 * scale);
+            Size size = getTextSize(text, FONT_HERSHEY_SIMPLEX, 0.35 * scale, previewThickness, &baseline);
+            area |= Rect(r.x - previewThickness - 2, y - size.height - previewThickness - 2,
+                size.width + 2 * previewThickness + 4, size.height + baseline + 2 * previewThickness + 4);
+        }
+        return area;
+    }
 
-    Mat labels;
-    vector<Rect> boundingBoxes;
-    int numComponents = labelConnectedComponentsClearText(binaryImage, labels, boundingBoxes);
+    void drawBlock(Mat& canvas, Point offset, int id) const {
+        Scalar color = store->find(id)->isValidated ? Scalar(0, 255, 0) : Scalar(0, 0, 255);
+        int thickness = max(2, (int)(2 * scale));
+        if (id == selected) {
+            color = Scalar(255, 255, 0);
+            thickness = max(4, (int)(4 * scale));
+        }
 
-    vector<bool> isTextComponent(numComponents + 1, false);
-    for (int i = 0; i < numComponents; i++) {
-        Rect box = boundingBoxes[i];
-        int area = box.area();
+        Rect r = displayRect(id) - offset;
+        rectangle(canvas, r, color, thickness);
+        putText(canvas, to_string(id + 1), Point(r.x, r.y - 5),
+            FONT_HERSHEY_SIMPLEX, 0.6 * scale, color, max(1, (int)(2 * scale)));
 
-        if (area > 10 && area < 5000 &&
-            box.width < originalImage.cols / 4 &&
-            box.height < originalImage.rows / 10 &&
-            box.width > 5 && box.height > 5) {
-            isTextComponent[i + 1] = true;
+        string text = preview(id);
+        if (!text.empty()) {
+            putText(canvas, text, Point(r.x, r.y + r.height + (int)(15 * scale)),
+                FONT_HERSHEY_SIMPLEX, 0.35 * scale, Scalar(255, 255, 255), max(1, (int)(1 * scale)));
         }
     }
 
-    Mat dilatedImage = Mat::zeros(binaryImage.size(), CV_8UC1);
-    dilatedImage.setTo(255);
-
-    for (int i = 0; i < labels.rows; i++) {
-        for (int j = 0; j < labels.cols; j++) {
-            int label = labels.at<int>(i, j);
-            if (label > 0 && isTextComponent[label]) {
-                dilatedImage.at<uchar>(i, j) = 0;
-            }
+    // Restores base under `dirty` and redraws, in id order, every block whose
+    // decoration reaches into it, so overlaps look the same as a full redraw.
+    void repaint(Rect dirty) {
+        dirty &= Rect(0, 0, overlay.cols, overlay.rows);
+        if (dirty.empty()) {
+            return;
         }
-    }
 
-    dilatedImage = dilateCustomClearText(dilatedImage, 5);
+        vector<int> ids;
+        decorationGrid.queryRect(dirty, [&](int id) { ids.push_back(id); });
+        sort(ids.begin(), ids.end());
 
-    Mat horizontalDilated = dilatedImage.clone();
-    for (int i = 0; i < dilatedImage.rows; i++) {
-        for (int j = 0; j < dilatedImage.cols; j++) {
-            if (dilatedImage.at<uchar>(i, j) == 0) {
-                for (int extend = 1; extend <= 10; extend++) {
-                    if (j + extend < horizontalDilated.cols) {
-                        horizontalDilated.at<uchar>(i, j + extend) = 0;
-                    }
-                    if (j - extend >= 0) {
-                        horizontalDilated.at<uchar>(i, j - extend) = 0;
-                    }
-                }
-            }
+        base(dirty).copyTo(overlay(dirty));
+        Mat view = overlay(dirty);
+        for (int id : ids) {
+            drawBlock(view, dirty.tl(), id);
         }
+        overlay(dirty).copyTo(frame(dirty));
     }
-    dilatedImage = horizontalDilated;
-
-    vector<Rect> finalBoundingBoxes;
-    vector<TextBlockClearText> textBlocks;
-    int finalComponents = labelConnectedComponentsClearText(dilatedImage, labels, finalBoundingBoxes);
 
-    for (int i = 0; i < finalComponents; i++) {
-        Rect box = finalBoundingBoxes[i];
-        if (box.area() > 200 && box.area() < originalImage.rows * originalImage.cols / 8) {
-            if (box.width > 20 && box.height > 10) {
-                textBlocks.push_back(TextBlockClearText(box));
-            }
+    // Call after the block was transcribed, selected/deselected or deleted.
+    void blockChanged(int id) {
+        if (id < 0 || id >= (int)decorations.size()) {
+            return;
         }
+        Rect previous = decorations[id];
+        if (store->find(id)) {
+            decorations[id] = decorationRect(id);
+            decorationGrid.update(id, decorations[id]);
+        }
+        else {
+            decorations[id] = Rect();
+            decorationGrid.remove(id);
+        }
+        repaint(previous | decorations[id]);
     }
 
-    printf("REZULTAT: %zu blocuri de text detectate\n", textBlocks.size());
-
-    imshow("1. Original", resizeForDisplayClearText(originalImage));
-    imshow("2. Grayscale", resizeForDisplayClearText(grayImage));
-    imshow("3. Binary", resizeForDisplayClearText(binaryImage));
-    imshow("4. Dilated", resizeForDisplayClearText(dilatedImage));
-
-    Mat blocksDisplay = originalImage.clone();
-    for (size_t i = 0; i < textBlocks.size(); i++) {
-        rectangle(blocksDisplay, textBlocks[i].boundingBox, Scalar(0, 0, 255), 2);
-        putText(blocksDisplay, to_string(i + 1),
-            Point(textBlocks[i].boundingBox.x, textBlocks[i].boundingBox.y - 5),
-            FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0, 0, 255), 2);
+    void setSelected(int id) {
+        if (id == selected) {
+            return;
+        }
+        int previous = selected;
+        selected = id;
+        blockChanged(previous);
+        blockChanged(selected);
     }
-    imshow("5. Blocuri Detectate", resizeForDisplayClearText(blocksDisplay));
-
-    printf("Apasa orice tasta pentru transcrierea cu mouse...\n");
-    waitKey();
-    destroyAllWindows();
-
-    printf("\n=== TRANSCRIEREA CU SELECTIE MOUSE ===\n");
-    printf("Instructiuni:\n");
-    printf("- Click STANGA pe un bloc pentru a-l selecta\n");
-    printf("- Click DREAPTA pentru a deselecta\n");
-    printf("- Apasa 't' pentru a transcrie blocul selectat\n");
-    printf("- Apasa 'd' pentru a sterge blocul selectat\n");
-    printf("- Apasa 's' pentru a salva si continua\n");
 
-    g_textBlocksClearText = &textBlocks;
-    g_selectedBlockClearText = -1;
-    g_needsUpdateClearText = true;
+    void drawHud() {
+        Rect hudArea = Rect(0, 0, frame.cols, (int)(130 * scale) + 10) & Rect(0, 0, frame.cols, frame.rows);
+        overlay(hudArea).copyTo(frame(hudArea));
 
-    Mat originalDisplay = resizeForDisplayClearText(originalImage);
-    g_displayScaleClearText = (double)originalDisplay.cols / originalImage.cols;
+        int thickness = max(1, (int)(2 * scale));
+        putText(frame, "Blocuri: " + to_string(store->size()),
+            Point(10, (int)(30 * scale)), FONT_HERSHEY_SIMPLEX, 0.7 * scale, Scalar(255, 255, 0), thickness);
 
-    namedWindow("ClearText - Transcriere cu Mouse", WINDOW_AUTOSIZE);
-    setMouseCallback("ClearText - Transcriere cu Mouse", onMouseCallbackClearText, nullptr);
+        int transcribed = 0;
+        for (int id = 0; id < store->idLimit(); id++) {
+            const TextBlockClearText* block = store->find(id);
+            if (block && block->isValidated) transcribed++;
+        }
+        putText(frame, "Transcrise: " + to_string(transcribed),
+            Point(10, (int)(60 * scale)), FONT_HERSHEY_SIMPLEX, 0.7 * scale, Scalar(0, 255, 0), thickness);
 
-    while (true) {
-        if (g_needsUpdateClearText) {
-            Mat display = originalDisplay.clone();
+        if (store->find(selected)) {
+            putText(frame, "Selectat: Bloc " + to_string(selected + 1),
+                Point(10, (int)(90 * scale)), FONT_HERSHEY_SIMPLEX, 0.7 * scale, Scalar(255, 255, 0), thickness);
+        }
+        else {
+            putText(frame, "Selectat: niciun bloc",
+                Point(10, (int)(90 * scale)), FONT_HERSHEY_SIMPLEX, 0.7 * scale, Scalar(128, 128, 128), thickness);
+        }
 
-            for (size_t i = 0; i < textBlocks.size(); i++) {
-                Scalar color;
-                int thickness = max(2, (int)(2 * g_displayScaleClearText));
+        putText(frame, "Click pe bloc=selecteaza, t=transcrie, d=sterge, s=salveaza",
+            Point(10, (int)(120 * scale)), FONT_HERSHEY_SIMPLEX, 0.4 * scale, Scalar(150, 150, 255), max(1, (int)(1 * scale)));
+    }
+};
 
-                if (textBlocks[i].isValidated) {
-                    color = Scalar(0, 255, 0);
-                }
-                else {
-                    color = Scalar(0, 0, 255);
-                }
+struct PreparedPageClearText {
+    string path;
+    PageClearText page;
+    SidecarSourceClearText source;
+    uint64 paramsHash = 0;
+    bool resumed = false;
+};
 
-                if ((int)i == g_selectedBlockClearText) {
-                    color = Scalar(255, 255, 0);
-                    thickness = max(4, (int)(4 * g_displayScaleClearText));
-                }
+// Load + detection for the interactive modes, resuming from the page's sidecar
+// when it is still valid. Returns false if the image cannot be read.
+bool preparePageClearText(const string& path, const DetectionParamsClearText& params, PreparedPageClearText& prepared) {
+    prepared.path = path;
+    prepared.page.original = imread(path, IMREAD_COLOR);
+    if (prepared.page.original.empty()) {
+        return false;
+    }
 
-                Rect displayRect((int)(textBlocks[i].boundingBox.x * g_displayScaleClearText),
-                    (int)(textBlocks[i].boundingBox.y * g_displayScaleClearText),
-                    (int)(textBlocks[i].boundingBox.width * g_displayScaleClearText),
-                    (int)(textBlocks[i].boundingBox.height * g_displayScaleClearText));
+    string sidecarPath = sidecarPathClearText(path);
+    prepared.source = sidecarSourceClearText(path);
+    prepared.paramsHash = paramsHashClearText(params);
+    prepared.resumed = loadPageSidecarClearText(sidecarPath, prepared.source, prepared.paramsHash, prepared.page);
+    if (!prepared.resumed) {
+        detectTextBlocksClearText(prepared.page, params);
+        if (!writePageSidecarClearText(sidecarPath, prepared.page, prepared.source, prepared.paramsHash)) {
+            printf("Nu am putut salva sesiunea in %s\n", sidecarPath.c_str());
+        }
+    }
+    return true;
+}
 
-                rectangle(display, displayRect, color, thickness);
-                putText(display, to_string(i + 1),
-                    Point(displayRect.x, displayRect.y - 5),
-                    FONT_HERSHEY_SIMPLEX, 0.6 * g_displayScaleClearText, color, max(1, (int)(2 * g_displayScaleClearText)));
+// One line typed by the operator, as UTF-8. A Windows console hands cin its
+// OEM/ANSI code page, which would turn ă, ș, ț into invalid UTF-8, so there the
+// line is read as UTF-16 with ReadConsoleW and converted; redirected input
+// goes through getline as everywhere else.
+bool readInputLineClearText(string& line) {
+#ifdef _WIN32
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD mode;
+    if (input != INVALID_HANDLE_VALUE && GetConsoleMode(input, &mode)) {
+        wstring wide;
+        wchar_t buffer[256];
+        DWORD numRead = 0;
+        while (ReadConsoleW(input, buffer, 256, &numRead, nullptr) && numRead > 0) {
+            wide.append(buffer, numRead);
+            if (wide.back() == L'\n') {
+                break;
+            }
+        }
+        if (wide.empty()) {
+            return false;
+        }
+        while (!wide.empty() && (wide.back() == L'\n' || wide.back() == L'\r')) {
+            wide.pop_back();
+        }
+        int size = WideCharToMultiByte(CP_UTF8, 0, wide.data(), (int)wide.size(), nullptr, 0, nullptr, nullptr);
+        line.assign(size, '\0');
+        if (size > 0) {
+            WideCharToMultiByte(CP_UTF8, 0, wide.data(), (int)wide.size(), &line[0], size, nullptr, nullptr);
+        }
+        return true;
+    }
+#endif
+    return (bool)getline(cin, line);
+}
 
-                if (textBlocks[i].isValidated && !textBlocks[i].transcribedText.empty()) {
-                    string preview = textBlocks[i].transcribedText.substr(0, 15);
-                    if (textBlocks[i].transcribedText.length() > 15) preview += "...";
-                    putText(display, preview,
-                        Point(displayRect.x, displayRect.y + displayRect.height + (int)(15 * g_displayScaleClearText)),
-                        FONT_HERSHEY_SIMPLEX, 0.35 * g_displayScaleClearText, Scalar(255, 255, 255), max(1, (int)(1 * g_displayScaleClearText)));
-                }
-            }
+// Mouse transcription loop on page.blocks; the edited blocks are written back
+// to the page when it ends. Returns the key that ended it ('s' or ESC).
+int transcribePageClearText(PageClearText& page, const string& windowName) {
+    const Mat& originalImage = page.original;
 
-            putText(display, "Blocuri: " + to_string(textBlocks.size()),
-                Point(10, (int)(30 * g_displayScaleClearText)), FONT_HERSHEY_SIMPLEX, 0.7 * g_displayScaleClearText, Scalar(255, 255, 0), max(1, (int)(2 * g_displayScaleClearText)));
+    TextBlockStoreClearText blockStore;
+    blockStore.reset(page.blocks, originalImage.size());
+    g_blockStoreClearText = &blockStore;
+    g_selectedBlockClearText = -1;
+    g_needsUpdateClearText = true;
 
-            int transcribed = 0;
-            for (const auto& block : textBlocks) {
-                if (block.isValidated) transcribed++;
-            }
-            putText(display, "Transcrise: " + to_string(transcribed),
-                Point(10, (int)(60 * g_displayScaleClearText)), FONT_HERSHEY_SIMPLEX, 0.7 * g_displayScaleClearText, Scalar(0, 255, 0), max(1, (int)(2 * g_displayScaleClearText)));
+    Mat originalDisplay = resizeForDisplayClearText(originalImage);
+    g_displayScaleClearText = (double)originalDisplay.cols / originalImage.cols;
 
-            if (g_selectedBlockClearText >= 0 && g_selectedBlockClearText < (int)textBlocks.size()) {
-                putText(display, "Selectat: Bloc " + to_string(g_selectedBlockClearText + 1),
-                    Point(10, (int)(90 * g_displayScaleClearText)), FONT_HERSHEY_SIMPLEX, 0.7 * g_displayScaleClearText, Scalar(255, 255, 0), max(1, (int)(2 * g_displayScaleClearText)));
-            }
-            else {
-                putText(display, "Selectat: niciun bloc",
-                    Point(10, (int)(90 * g_displayScaleClearText)), FONT_HERSHEY_SIMPLEX, 0.7 * g_displayScaleClearText, Scalar(128, 128, 128), max(1, (int)(2 * g_displayScaleClearText)));
-            }
+    namedWindow(windowName, WINDOW_AUTOSIZE);
+    setMouseCallback(windowName, onMouseCallbackClearText, nullptr);
 
-            putText(display, "Click pe bloc=selecteaza, t=transcrie, d=sterge, s=salveaza",
-                Point(10, (int)(120 * g_displayScaleClearText)), FONT_HERSHEY_SIMPLEX, 0.4 * g_displayScaleClearText, Scalar(150, 150, 255), max(1, (int)(1 * g_displayScaleClearText)));
+    BlockOverlayRendererClearText overlayRenderer;
+    overlayRenderer.reset(originalDisplay, g_displayScaleClearText, blockStore);
 
-            imshow("ClearText - Transcriere cu Mouse", display);
+    int key;
+    while (true) {
+        if (g_needsUpdateClearText) {
+            overlayRenderer.setSelected(g_selectedBlockClearText);
+            overlayRenderer.drawHud();
+            imshow(windowName, overlayRenderer.frame);
             g_needsUpdateClearText = false;
         }
 
-        char key = waitKey(30) & 0xFF;
+        key = waitKey(30) & 0xFF;
         if (key == 27) {
             printf("ESC apasat - iesire din validare.\n");
             break;
         }
 
         if (key == 't' || key == 'T') {
-            if (g_selectedBlockClearText >= 0 && g_selectedBlockClearText < (int)textBlocks.size()) {
+            TextBlockClearText* selectedBlock = blockStore.find(g_selectedBlockClearText);
+            if (selectedBlock) {
                 printf("\n=== TRANSCRIEREA BLOCULUI %d ===\n", g_selectedBlockClearText + 1);
                 printf("Introdu textul din aceasta regiune: ");
 
                 string text;
-                getline(cin, text);
+                readInputLineClearText(text);
 
                 if (!text.empty()) {
-                    textBlocks[g_selectedBlockClearText].transcribedText = text;
-                    textBlocks[g_selectedBlockClearText].isValidated = true;
+                    selectedBlock->transcribedText = text;
+                    selectedBlock->isValidated = true;
                     printf("Text salvat: \"%s\"\n", text.c_str());
+                    overlayRenderer.blockChanged(g_selectedBlockClearText);
                     g_needsUpdateClearText = true;
                 }
                 else {
@@ -489,9 +6153,9 @@ void testClearTextWithMouseSelection() {
         }
 
         if (key == 'd' || key == 'D') {
-            if (g_selectedBlockClearText >= 0 && g_selectedBlockClearText < (int)textBlocks.size()) {
+            if (blockStore.remove(g_selectedBlockClearText)) {
                 printf("Sterg blocul %d\n", g_selectedBlockClearText + 1);
-                textBlocks.erase(textBlocks.begin() + g_selectedBlockClearText);
+                overlayRenderer.blockChanged(g_selectedBlockClearText);
                 g_selectedBlockClearText = -1;
                 g_needsUpdateClearText = true;
                 printf("Bloc sters cu succes.\n");
@@ -503,219 +6167,673 @@ void testClearTextWithMouseSelection() {
 
         if (key == 's' || key == 'S') {
             printf("Salvez si continui...\n");
+            key = 's';
             break;
         }
     }
 
-    g_textBlocksClearText = nullptr;
+    blockStore.exportBlocks(page.blocks);
+    g_blockStoreClearText = nullptr;
     g_selectedBlockClearText = -1;
-    destroyWindow("ClearText - Transcriere cu Mouse");
+    destroyWindow(windowName);
+    return key;
+}
+
+void printTranscriptionInstructionsClearText() {
+    printf("\n=== TRANSCRIEREA CU SELECTIE MOUSE ===\n");
+    printf("Instructiuni:\n");
+    printf("- Click STANGA pe un bloc pentru a-l selecta\n");
+    printf("- Click DREAPTA pentru a deselecta\n");
+    printf("- Apasa 't' pentru a transcrie blocul selectat\n");
+    printf("- Apasa 'd' pentru a sterge blocul selectat\n");
+    printf("- Apasa 's' pentru a salva si continua\n");
+}
+
+void testClearTextWithMouseSelection() {
+
+    char fname[MAX_PATH];
+    if (!openFileDlg(fname)) {
+        printf("Nu a fost selectata nicio imagine.\n");
+        return;
+    }
+
+    TRACE_PAGE_CLEARTEXT(string(fname) + "_trace.json");
+
+    DetectionParamsClearText params;
+    string paramsPath = detectionParamsPathClearText(fileDirectoryClearText(fname));
+    if (readDetectionParamsClearText(paramsPath, params)) {
+        printf("Parametri de detectie din %s\n", paramsPath.c_str());
+    }
+    PreparedPageClearText prepared;
+    printf("\n=== DETECTIA BLOCURILOR DE TEXT ===\n");
+    if (!preparePageClearText(fname, params, prepared)) {
+        printf("Nu am putut incarca imaginea: %s\n", fname);
+        return;
+    }
+    if (prepared.resumed) {
+        printf("=== SESIUNE RELUATA DIN %s ===\n", sidecarPathClearText(fname).c_str());
+    }
+
+    PageClearText& page = prepared.page;
+    const Mat& originalImage = page.original;
+    vector<TextBlockClearText>& textBlocks = page.blocks;
+
+    printf("REZULTAT: %zu blocuri de text detectate\n", textBlocks.size());
+
+    imshow("1. Original", resizeForDisplayClearText(originalImage));
+    if (!page.gray.empty()) {
+        imshow("2. Grayscale", resizeForDisplayClearText(page.gray));
+    }
+    imshow("3. Binary", resizeForDisplayClearText(binaryBytesClearText(page)));
+    if (!page.dilated.empty()) {
+        imshow("4. Dilated", resizeForDisplayClearText(page.dilated));
+    }
+
+    Mat blocksDisplay = originalImage.clone();
+    for (size_t i = 0; i < textBlocks.size(); i++) {
+        rectangle(blocksDisplay, textBlocks[i].boundingBox, Scalar(0, 0, 255), 2);
+        putText(blocksDisplay, to_string(i + 1),
+            Point(textBlocks[i].boundingBox.x, textBlocks[i].boundingBox.y - 5),
+            FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0, 0, 255), 2);
+    }
+    imshow("5. Blocuri Detectate", resizeForDisplayClearText(blocksDisplay));
+
+    printf("Apasa orice tasta pentru transcrierea cu mouse...\n");
+    waitKey();
+    destroyAllWindows();
+
+    printTranscriptionInstructionsClearText();
+    transcribePageClearText(page, "ClearText - Transcriere cu Mouse");
+
+    string sidecarPath = sidecarPathClearText(fname);
+    if (!writePageSidecarClearText(sidecarPath, page, prepared.source, prepared.paramsHash)) {
+        printf("Nu am putut salva sesiunea in %s\n", sidecarPath.c_str());
+    }
 
     printf("\n=== RECONSTRUIREA FUNDALULUI ===\n");
 
-    Mat mask = Mat::zeros(originalImage.size(), CV_8UC1);
+    Mat backgroundOnly, result;
+    reconstructPageClearText(page, backgroundOnly, result);
+
+    printf("RENDERING COMPLET!\n");
+
+    imshow("6. Fundal Reconstituit", resizeForDisplayClearText(backgroundOnly));
+    imshow("7. Rezultat Final ClearText", resizeForDisplayClearText(result));
+    moveWindow("6. Fundal Reconstituit", 50, 50);
+    moveWindow("7. Rezultat Final ClearText", 400, 50);
+    printf("              REZULTATE                 \n");
+    printf("\n");
+    printf("Blocuri detectate: %zu\n", textBlocks.size());
 
+    int transcribed = 0;
     for (const auto& block : textBlocks) {
-        Mat blockRegion = binaryImage(block.boundingBox);
-        Mat maskRegion = mask(block.boundingBox);
+        if (block.isValidated) transcribed++;
+    }
+    printf("Blocuri transcrise: %d\n", transcribed);
 
-        for (int i = 0; i < blockRegion.rows; i++) {
-            for (int j = 0; j < blockRegion.cols; j++) {
-                if (blockRegion.at<uchar>(i, j) == 0) {
-                    maskRegion.at<uchar>(i, j) = 0;
-                }
-                else {
-                    maskRegion.at<uchar>(i, j) = 255;
-                }
-            }
+    printf("\nTexte transcrise:\n");
+    for (size_t i = 0; i < textBlocks.size(); i++) {
+        if (textBlocks[i].isValidated) {
+            printf("Bloc %d: \"%s\"\n", textBlocks[i].id + 1, textBlocks[i].transcribedText.c_str());
         }
     }
 
-    Mat backgroundOnly = simpleInpaintingClearText(originalImage, mask);
-    Mat result = backgroundOnly.clone();
+    printf("\nApasa orice tasta pentru a inchide...\n");
+    waitKey();
+    destroyAllWindows();
+}
 
-    for (size_t i = 0; i < textBlocks.size(); i++) {
-        if (!textBlocks[i].isValidated || textBlocks[i].transcribedText.empty()) {
-            continue;
+// Re-detection for the tuning mode. Binarization and the first labeling pass do
+// not depend on the tuned thresholds, so the component boxes are computed once
+// and a change re-runs only the steps after it: component thresholds re-filter
+// the boxes, the kernel re-clusters the kept ones (box clustering, whose cost
+// depends on the number of components, not of pixels) and block thresholds
+// re-filter the cached clusters.
+struct DetectionTunerClearText {
+    PageClearText* page = nullptr;
+    Mat labels;
+    vector<Rect> boundingBoxes;
+    DetectionParamsClearText params;
+    vector<Rect> textBoxes;
+    vector<Rect> clusters;
+    vector<TextBlockClearText> blocks;
+
+    void reset(PageClearText& binarizedPage, const DetectionParamsClearText& initial) {
+        page = &binarizedPage;
+        params = initial;
+        labelComponentsUnionFindClearText(page->binary, labels, boundingBoxes, nullptr, 0, params.connectivity);
+        filterComponents();
+        clusterTextBoxesClearText(textBoxes, page->binary.size(), blockKernelClearText(params), clusters);
+        keepTextBlocksClearText(clusters, page->binary.size(), params, blocks);
+    }
+
+    void filterComponents() {
+        textBoxes.clear();
+        for (const Rect& box : boundingBoxes) {
+            if (isTextComponentClearText(box, page->binary.size(), params)) {
+                textBoxes.push_back(box);
+            }
         }
+    }
 
-        const TextBlockClearText& block = textBlocks[i];
-        printf("Bloc %zu: rendering \"%s\"\n", i + 1,
-            block.transcribedText.substr(0, 30).c_str());
+    // Returns false when next has the same thresholds.
+    bool update(const DetectionParamsClearText& next) {
+        bool componentsChanged = next.minComponentArea != params.minComponentArea ||
+            next.maxComponentArea != params.maxComponentArea ||
+            next.maxComponentWidthDiv != params.maxComponentWidthDiv ||
+            next.maxComponentHeightDiv != params.maxComponentHeightDiv ||
+            next.minComponentSide != params.minComponentSide;
+        bool kernelChanged = blockKernelClearText(next) != blockKernelClearText(params);
+        bool blocksChanged = next.minBlockArea != params.minBlockArea ||
+            next.maxBlockAreaDiv != params.maxBlockAreaDiv ||
+            next.minBlockWidth != params.minBlockWidth || next.minBlockHeight != params.minBlockHeight;
+        if (!componentsChanged && !kernelChanged && !blocksChanged) {
+            return false;
+        }
 
-        vector<double> fontSizes = { 0.8, 1.0, 1.2, 1.4, 1.6, 1.8, 2.0, 2.5, 3.0 };
-        double bestFontScale = 0.8;
-        int thickness = 1.2;
+        params = next;
+        if (componentsChanged) {
+            filterComponents();
+        }
+        if (componentsChanged || kernelChanged) {
+            clusterTextBoxesClearText(textBoxes, page->binary.size(), blockKernelClearText(params), clusters);
+        }
+        keepTextBlocksClearText(clusters, page->binary.size(), params, blocks);
+        return true;
+    }
 
-        int blockWidth = block.boundingBox.width;
-        int blockHeight = block.boundingBox.height;
+    // The blocks the full detection forms by pixel dilation, from the cached
+    // labels; they differ from the preview only where a box gap bridges lines.
+    void formWithDilation() {
+        DetectionParamsClearText pixelParams = params;
+        pixelParams.blockFormation = BlockFormationModeClearText::PixelDilation;
+        formTextBlocksClearText(*page, labels, boundingBoxes, pixelParams);
+        blocks = page->blocks;
+    }
+};
 
-        printf("   Dimensiuni bloc: %dx%d pixeli\n", blockWidth, blockHeight);
+// Trackbars for the detection thresholds on one page, with the blocks redrawn
+// on every change. 's' writes the values to cleartext.params next to the
+// image, where the transcription modes pick them up.
+void tuneDetectionParamsClearText() {
 
-        vector<string> words;
-        istringstream iss(block.transcribedText);
-        string word;
-        while (iss >> word) {
-            words.push_back(word);
-        }
+    char fname[MAX_PATH];
+    if (!openFileDlg(fname)) {
+        printf("Nu a fost selectata nicio imagine.\n");
+        return;
+    }
 
-        for (double testFont : fontSizes) {
-            vector<string> testLines;
-            string currentLine = "";
-            bool fontFits = true;
+    string paramsPath = detectionParamsPathClearText(fileDirectoryClearText(fname));
+    DetectionParamsClearText params;
+    if (readDetectionParamsClearText(paramsPath, params)) {
+        printf("Parametri de detectie din %s\n", paramsPath.c_str());
+    }
 
-            for (const string& w : words) {
-                string testLine;
-                if (currentLine.empty()) {
-                    testLine = w;
-                }
-                else {
-                    testLine = currentLine + " " + w;
-                }
+    PageClearText page;
+    page.original = imread(fname, IMREAD_COLOR);
+    if (page.original.empty()) {
+        printf("Nu am putut incarca imaginea: %s\n", fname);
+        return;
+    }
+    int hist[256];
+    grayscaleHistogramClearText(page.original, page.gray, hist);
+    binarizeGrayClearText(page.gray, hist, params, page.binary);
+
+    DetectionTunerClearText tuner;
+    tuner.reset(page, params);
+
+    Mat display = resizeForDisplayClearText(page.original);
+    double scale = (double)display.cols / page.original.cols;
+    const string windowName = "ClearText - Reglare parametri";
+    namedWindow(windowName, WINDOW_AUTOSIZE);
+    for (const auto& tunable : g_tunableParamsClearText) {
+        createTrackbar(tunable.label, windowName, nullptr, tunable.maxValue);
+        setTrackbarMin(tunable.label, windowName, tunable.minValue);
+        setTrackbarPos(tunable.label, windowName, params.*tunable.field);
+    }
 
-                Size testSize = getTextSize(testLine, FONT_HERSHEY_SIMPLEX,
-                    testFont, thickness, nullptr);
+    printf("\n=== REGLAREA PARAMETRILOR DE DETECTIE ===\n");
+    printf("- Muta cursoarele: blocurile se recalculeaza din componentele deja etichetate\n");
+    printf("- Apasa 'c' pentru a afisa componentele pastrate\n");
+    printf("- Apasa 'v' pentru blocurile formate prin dilatare (ca la transcriere)\n");
+    printf("- Apasa 's' pentru a salva parametrii in %s\n", paramsPath.c_str());
+    printf("- Apasa ESC pentru a renunta\n");
+
+    auto scaled = [scale](const Rect& r) {
+        return Rect((int)(r.x * scale), (int)(r.y * scale), (int)(r.width * scale), (int)(r.height * scale));
+    };
+
+    Mat frame;
+    bool showComponents = false;
+    bool dilated = false;
+    bool redraw = true;
+    int64 start = getTickCount();
+    while (true) {
+        DetectionParamsClearText next = tuner.params;
+        for (const auto& tunable : g_tunableParamsClearText) {
+            next.*tunable.field = max(tunable.minValue, getTrackbarPos(tunable.label, windowName));
+        }
+        if (tuner.update(next)) {
+            dilated = false;
+            redraw = true;
+        }
 
-                if (testSize.width <= blockWidth - 6) {
-                    currentLine = testLine;
-                }
-                else {
-                    if (!currentLine.empty()) {
-                        testLines.push_back(currentLine);
-                        currentLine = w;
-                    }
-                    else {
-                        fontFits = false;
-                        break;
-                    }
+        if (redraw) {
+            display.copyTo(frame);
+            if (showComponents) {
+                for (const Rect& box : tuner.textBoxes) {
+                    rectangle(frame, scaled(box), Scalar(160, 160, 160), 1);
                 }
             }
-            if (!currentLine.empty()) {
-                testLines.push_back(currentLine);
+            for (const auto& block : tuner.blocks) {
+                rectangle(frame, scaled(block.boundingBox), dilated ? Scalar(0, 255, 0) : Scalar(0, 0, 255), 2);
             }
+            double elapsedMs = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+            putText(frame, "Blocuri: " + to_string(tuner.blocks.size()) + "  Componente: " +
+                to_string(tuner.textBoxes.size()) + "/" + to_string(tuner.boundingBoxes.size()),
+                Point(10, 25), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(255, 255, 0), 2);
+            char timing[64];
+            snprintf(timing, sizeof(timing), "Recalculare: %.1f ms (%s)", elapsedMs, dilated ? "dilatare" : "cutii");
+            putText(frame, timing, Point(10, 50), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(255, 255, 0), 2);
+            putText(frame, "c=componente, v=verifica prin dilatare, s=salveaza, ESC=renunta",
+                Point(10, 75), FONT_HERSHEY_SIMPLEX, 0.45, Scalar(150, 150, 255), 1);
+            imshow(windowName, frame);
+            redraw = false;
+        }
 
-            if (fontFits && !testLines.empty()) {
-                Size sampleSize = getTextSize("Ag", FONT_HERSHEY_SIMPLEX, testFont, thickness, nullptr);
-                int lineHeight = sampleSize.height + 2;
-                int totalHeight = testLines.size() * lineHeight;
-
-                if (totalHeight <= blockHeight - 6) {
-                    bestFontScale = testFont;
-                    printf("   Font %0.1f se potriveste: %d linii, inaltime %d\n", testFont, (int)testLines.size(), totalHeight);
-                }
-                else {
-                    printf("   Font %0.1f prea inalt: %d linii, inaltime %d > %d\n", testFont, (int)testLines.size(), totalHeight, blockHeight - 6);
-                    break;
+        int key = waitKey(15) & 0xFF;
+        start = getTickCount();
+        if (key == 27) {
+            printf("Parametrii nu au fost salvati.\n");
+            break;
+        }
+        if (key == 'c' || key == 'C') {
+            showComponents = !showComponents;
+            redraw = true;
+        }
+        if (key == 'v' || key == 'V') {
+            tuner.formWithDilation();
+            dilated = true;
+            redraw = true;
+        }
+        if (key == 's' || key == 'S') {
+            if (writeDetectionParamsClearText(paramsPath, tuner.params)) {
+                printf("Parametri salvati in %s:\n", paramsPath.c_str());
+                for (const auto& tunable : g_tunableParamsClearText) {
+                    printf("  %s %d\n", tunable.key, tuner.params.*tunable.field);
                 }
             }
             else {
-                printf("   Font %0.1f prea lat\n", testFont);
-                break;
+                printf("Nu am putut salva parametrii in %s\n", paramsPath.c_str());
             }
+            break;
         }
+    }
 
-        if (bestFontScale < 0.8) {
-            bestFontScale = 0.8;
-            printf("   FORTAT: Font marit la %.1f pentru vizibilitate\n", bestFontScale);
-        }
+    destroyWindow(windowName);
+}
 
-        printf("   Font final: %.1f, thickness: %d\n", bestFontScale, thickness);
+// One background thread running the submitted tasks in order. The destructor
+// finishes the tasks already queued before joining.
+struct TaskQueueClearText {
+    mutex queueMutex;
+    condition_variable wake;
+    queue<function<void()>> tasks;
+    bool stopping = false;
+    thread worker;
+
+    TaskQueueClearText() : worker([this]() { run(); }) {}
+
+    ~TaskQueueClearText() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
 
-        vector<string> finalLines;
-        string currentLine = "";
+    TaskQueueClearText(const TaskQueueClearText&) = delete;
+    TaskQueueClearText& operator=(const TaskQueueClearText&) = delete;
 
-        for (const string& w : words) {
-            string testLine;
-            if (currentLine.empty()) {
-                testLine = w;
-            }
-            else {
-                testLine = currentLine + " " + w;
-            }
-            Size testSize = getTextSize(testLine, FONT_HERSHEY_SIMPLEX,
-                bestFontScale, thickness, nullptr);
+    template <typename Result>
+    future<Result> submit(function<Result()> job) {
+        auto task = make_shared<packaged_task<Result()>>(move(job));
+        future<Result> result = task->get_future();
+        {
+            lock_guard<mutex> lock(queueMutex);
+            tasks.push([task]() { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
 
-            if (testSize.width <= blockWidth - 6) {
-                currentLine = testLine;
-            }
-            else {
-                if (!currentLine.empty()) {
-                    finalLines.push_back(currentLine);
-                    currentLine = w;
-                }
-                else {
-                    finalLines.push_back(w);
+    void run() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
                 }
+                task = move(tasks.front());
+                tasks.pop();
             }
+            task();
         }
-        if (!currentLine.empty()) {
-            finalLines.push_back(currentLine);
-        }
-
-        Size sampleSize = getTextSize("Ag", FONT_HERSHEY_SIMPLEX, bestFontScale, thickness, nullptr);
-        int lineHeight = sampleSize.height + 3;
-        int startY = block.boundingBox.y + lineHeight;
+    }
+};
 
-        printf("   Randare: %d linii cu font %.1f\n", (int)finalLines.size(), bestFontScale);
+// Waits for a background result while keeping the HighGUI windows responsive.
+template <typename Result>
+Result waitKeepingUiAliveClearText(future<Result>& pending) {
+    while (pending.wait_for(chrono::milliseconds(30)) != future_status::ready) {
+        waitKey(1);
+    }
+    return pending.get();
+}
 
-        for (size_t l = 0; l < finalLines.size(); l++) {
-            int y = startY + (int)l * lineHeight;
+// Whole-folder transcription. While the operator works on page N, page N + 1 is
+// loaded and detected on one background thread, and the pages already saved are
+// reconstructed, rendered and written on another; the UI thread only waits when
+// the operator is faster than detection. Results go to <folder>/cleartext.
+void transcribeFolderClearText() {
 
-            if (y > originalImage.rows - 10) {
-                printf("   Linia %d iese din imagine\n", (int)l);
-                break;
-            }
+    char folderName[MAX_PATH];
+    if (!openFolderDlg(folderName)) {
+        printf("Nu a fost selectat niciun folder.\n");
+        return;
+    }
 
-            Size lineSize = getTextSize(finalLines[l], FONT_HERSHEY_SIMPLEX,
-                bestFontScale, thickness, nullptr);
+    vector<string> files = listImageFilesClearText(folderName);
+    string outputDir = string(folderName) + "/cleartext";
+    if (files.empty()) {
+        printf("Nu am gasit imagini in %s\n", folderName);
+        return;
+    }
+    if (!utils::fs::createDirectories(outputDir)) {
+        printf("Nu am putut crea directorul de iesire: %s\n", outputDir.c_str());
+        return;
+    }
 
-            int padding = 3;
-            Rect textBg(max(0, block.boundingBox.x - padding),
-                max(0, y - lineSize.height - padding),
-                min(originalImage.cols - block.boundingBox.x, lineSize.width + 2 * padding),
-                lineSize.height + 2 * padding);
+    DetectionParamsClearText params;
+    string paramsPath = detectionParamsPathClearText(folderName);
+    if (readDetectionParamsClearText(paramsPath, params)) {
+        printf("Parametri de detectie din %s\n", paramsPath.c_str());
+    }
+    bool verbose = g_verboseClearText;
+    g_verboseClearText = false;
+
+    TaskQueueClearText detectQueue;
+    TaskQueueClearText finishQueue;
+    vector<future<bool>> savedPages;
+
+    auto prefetch = [&](size_t index) {
+        string path = files[index];
+        return detectQueue.submit<shared_ptr<PreparedPageClearText>>([path, &params]() {
+            // An empty original marks a page that could not be loaded.
+            auto prepared = make_shared<PreparedPageClearText>();
+            preparePageClearText(path, params, *prepared);
+            return prepared;
+        });
+    };
+
+    printf("%zu pagini in %s\n", files.size(), folderName);
+    printTranscriptionInstructionsClearText();
+    printf("- Apasa ESC pentru a salva pagina curenta si a te opri\n");
+
+    future<shared_ptr<PreparedPageClearText>> next = prefetch(0);
+    for (size_t index = 0; index < files.size(); index++) {
+        if (next.wait_for(chrono::seconds(0)) != future_status::ready) {
+            printf("Astept detectia pentru %s...\n", fileNameClearText(files[index]).c_str());
+        }
+        shared_ptr<PreparedPageClearText> prepared = waitKeepingUiAliveClearText(next);
+        if (index + 1 < files.size()) {
+            next = prefetch(index + 1);
+        }
 
-            rectangle(result, textBg, Scalar(255, 255, 255), -1);
+        if (prepared->page.original.empty()) {
+            printf("Nu am putut incarca imaginea: %s\n", files[index].c_str());
+            continue;
+        }
 
-            putText(result, finalLines[l],
-                Point(block.boundingBox.x + 2, y),
-                FONT_HERSHEY_SIMPLEX, bestFontScale, Scalar(0, 0, 0), thickness + 1);
+        printf("\n=== PAGINA %zu/%zu: %s (%zu blocuri%s) ===\n", index + 1, files.size(),
+            fileNameClearText(files[index]).c_str(), prepared->page.blocks.size(),
+            prepared->resumed ? ", sesiune reluata" : "");
+        int key = transcribePageClearText(prepared->page, "ClearText - " + fileNameClearText(files[index]));
+
+        // The detection intermediates are not needed for reconstruction.
+        prepared->page.gray.release();
+        prepared->page.dilated.release();
+        string stem = outputDir + "/" + fileStemClearText(files[index]);
+        savedPages.push_back(finishQueue.submit<bool>([prepared, stem]() {
+            PageClearText& page = prepared->page;
+            bool ok = writePageSidecarClearText(sidecarPathClearText(prepared->path), page,
+                prepared->source, prepared->paramsHash);
+
+            Mat backgroundOnly, result;
+            reconstructPageClearText(page, backgroundOnly, result);
+            return imwrite(stem + "_clean.png", result) &&
+                writeBlocksFileClearText(stem + "_blocks.txt", page.blocks) && ok;
+        }));
 
-            printf("   Linia %d: \"%s\" cu font %.1f\n", (int)l, finalLines[l].c_str(), bestFontScale);
+        if (key == 27) {
+            break;
         }
+    }
+    // After ESC the next page may still be in detection, which reads
+    // g_verboseClearText; it is drained here, with the windows kept alive,
+    // before the flag is restored and the queue joins its thread.
+    if (next.valid()) {
+        waitKeepingUiAliveClearText(next);
+    }
 
-        printf("   FINALIZAT cu font %.1f!\n", bestFontScale);
+    printf("Astept salvarea paginilor...\n");
+    size_t failed = 0;
+    for (auto& saved : savedPages) {
+        if (!waitKeepingUiAliveClearText(saved)) {
+            failed++;
+        }
     }
+    printf("%zu pagini salvate in %s, %zu erori\n", savedPages.size(), outputDir.c_str(), failed);
 
-    printf("RENDERING COMPLET!\n");
+    g_verboseClearText = verbose;
+}
 
-    imshow("6. Fundal Reconstituit", resizeForDisplayClearText(backgroundOnly));
-    imshow("7. Rezultat Final ClearText", resizeForDisplayClearText(result));
-    moveWindow("6. Fundal Reconstituit", 50, 50);
-    moveWindow("7. Rezultat Final ClearText", 400, 50);
-    printf("              REZULTATE                 \n");
-    printf("\n");
-    printf("Blocuri detectate: %zu\n", textBlocks.size());
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    // Transcriptions are UTF-8; echo them (and the atlas' diacritics) as such.
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+    g_kernelsClearText = selectKernelSetClearText(getenv("CLEARTEXT_KERNELS"));
 
-    int transcribed = 0;
-    for (const auto& block : textBlocks) {
-        if (block.isValidated) transcribed++;
+    if (argc > 1 && string(argv[1]) == "--build-atlas") {
+        return buildGlyphAtlasFileClearText(argc > 2 ? argv[2] : g_glyphAtlasPathClearText, argc > 3 ? argv[3] : "");
     }
-    printf("Blocuri transcrise: %d\n", transcribed);
 
-    printf("\nTexte transcrise:\n");
-    for (size_t i = 0; i < textBlocks.size(); i++) {
-        if (textBlocks[i].isValidated) {
-            printf("Bloc %zu: \"%s\"\n", i + 1, textBlocks[i].transcribedText.c_str());
+    if (argc > 1 && string(argv[1]) == "--verify-kernels") {
+        return verifyKernelsClearText(argc > 2 ? argv[2] : "", DetectionParamsClearText());
+    }
+
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        auto benchUsage = [&]() {
+            printf("Utilizare: %s --bench [rezultate.csv] [--repeat N] [--threads N] [--affinity] [--reference] [--atlas fisier]\n", argv[0]);
+            return 1;
+        };
+        string outputPath;
+        int repeats = 5;
+        bool withReference = false;
+        for (int a = 2; a < argc; a++) {
+            string arg = argv[a];
+            if (arg == "--repeat" && a + 1 < argc) {
+                repeats = atoi(argv[++a]);
+                if (repeats < 1) {
+                    printf("Numarul de repetari trebuie sa fie >= 1: %s\n", argv[a]);
+                    return benchUsage();
+                }
+            }
+            else if (arg == "--threads" && a + 1 < argc) {
+                g_poolWorkersClearText = atoi(argv[++a]);
+                if (g_poolWorkersClearText < 1) {
+                    printf("Numarul de fire trebuie sa fie >= 1: %s\n", argv[a]);
+                    return benchUsage();
+                }
+            }
+            else if (arg == "--affinity") {
+                g_poolAffinityClearText = true;
+            }
+            else if (arg == "--reference") {
+                withReference = true;
+            }
+            else if (arg == "--atlas" && a + 1 < argc) {
+                g_glyphAtlasPathClearText = argv[++a];
+            }
+            else if (arg.compare(0, 2, "--") != 0 && outputPath.empty()) {
+                outputPath = arg;
+            }
+            else {
+                printf("Argument necunoscut: %s\n", arg.c_str());
+                return benchUsage();
+            }
         }
+        return runBenchmarkClearText(outputPath, repeats, withReference, DetectionParamsClearText());
     }
 
-    printf("\nApasa orice tasta pentru a inchide...\n");
-    waitKey();
-    destroyAllWindows();
-}
+    if (argc > 1 && string(argv[1]) == "--batch") {
+        auto batchUsage = [&]() {
+            printf("Utilizare: %s --batch <dir_intrare> <dir_iesire> [numar_fire] [--inpaint frontier|background|reference] [--memory-budget-mb N] [--binarize global|sauvola|niblack] [--window N] [--blocks dilate|boxes] [--pyramid 2|4] [--connectivity 4|8] [--params fisier] [--sidecar] [--verify-sidecar] [--transcripts dir] [--atlas fisier] [--affinity]\n", argv[0]);
+            return 1;
+        };
+        vector<string> args;
+        DetectionParamsClearText params;
+        for (int a = 2; a < argc; a++) {
+            string arg = argv[a];
+            if (arg == "--affinity") {
+                g_poolAffinityClearText = true;
+            }
+            else if (arg == "--inpaint-reference") {
+                g_inpaintModeClearText = InpaintModeClearText::IterativeReference;
+            }
+            else if (arg == "--inpaint" && a + 1 < argc) {
+                string mode = argv[++a];
+                if (mode == "background") {
+                    g_inpaintModeClearText = InpaintModeClearText::BackgroundModel;
+                }
+                else if (mode == "reference") {
+                    g_inpaintModeClearText = InpaintModeClearText::IterativeReference;
+                }
+                else if (mode == "frontier") {
+                    g_inpaintModeClearText = InpaintModeClearText::Frontier;
+                }
+                else {
+                    printf("Mod de inpainting necunoscut: %s\n", mode.c_str());
+                    return batchUsage();
+                }
+            }
+            else if (arg == "--memory-budget-mb" && a + 1 < argc) {
+                g_memoryBudgetClearText = (size_t)atoi(argv[++a]) << 20;
+            }
+            else if (arg == "--binarize" && a + 1 < argc) {
+                string mode = argv[++a];
+                if (mode == "sauvola") {
+                    params.binarization = BinarizationModeClearText::Sauvola;
+                }
+                else if (mode == "niblack") {
+                    params.binarization = BinarizationModeClearText::Niblack;
+                }
+                else if (mode == "global") {
+                    params.binarization = BinarizationModeClearText::GlobalIterative;
+                }
+                else {
+                    printf("Mod de binarizare necunoscut: %s\n", mode.c_str());
+                    return batchUsage();
+                }
+            }
+            else if (arg == "--window" && a + 1 < argc) {
+                // The window is centered on the pixel, so only odd sizes exist.
+                int window = atoi(argv[++a]);
+                if (window < 3 || window % 2 == 0) {
+                    printf("Fereastra trebuie sa fie un numar impar >= 3: %s\n", argv[a]);
+                    return batchUsage();
+                }
+                params.adaptiveWindow = window;
+            }
+            else if (arg == "--sidecar") {
+                g_useSidecarsClearText = true;
+            }
+            else if (arg == "--verify-sidecar") {
+                g_useSidecarsClearText = true;
+                g_verifySidecarsClearText = true;
+            }
+            else if (arg == "--transcripts" && a + 1 < argc) {
+                g_transcriptDirClearText = argv[++a];
+            }
+            else if (arg == "--atlas" && a + 1 < argc) {
+                g_glyphAtlasPathClearText = argv[++a];
+            }
+            else if (arg == "--params" && a + 1 < argc) {
+                string paramsPath = argv[++a];
+                if (!readDetectionParamsClearText(paramsPath, params)) {
+                    printf("Nu am putut citi parametrii din %s\n", paramsPath.c_str());
+                    return 1;
+                }
+            }
+            else if (arg == "--connectivity" && a + 1 < argc) {
+                int connectivity = atoi(argv[++a]);
+                if (connectivity != 4 && connectivity != 8) {
+                    printf("Conectivitatea trebuie sa fie 4 sau 8: %s\n", argv[a]);
+                    return batchUsage();
+                }
+                params.connectivity = connectivity;
+            }
+            else if (arg == "--pyramid" && a + 1 < argc) {
+                int factor = atoi(argv[++a]);
+                if (factor != 2 && factor != 4) {
+                    printf("Factorul piramidei trebuie sa fie 2 sau 4: %s\n", argv[a]);
+                    return batchUsage();
+                }
+                params.pyramidFactor = factor;
+            }
+            else if (arg == "--blocks" && a + 1 < argc) {
+                string mode = argv[++a];
+                if (mode == "boxes") {
+                    params.blockFormation = BlockFormationModeClearText::BoxClustering;
+                }
+                else if (mode == "dilate") {
+                    params.blockFormation = BlockFormationModeClearText::PixelDilation;
+                }
+                else {
+                    printf("Mod de formare a blocurilor necunoscut: %s\n", mode.c_str());
+                    return batchUsage();
+                }
+            }
+            else {
+                args.push_back(arg);
+            }
+        }
+        if (args.size() < 2) {
+            return batchUsage();
+        }
+        if (args.size() > 2) {
+            g_poolWorkersClearText = atoi(args[2].c_str());
+        }
+        if (g_memoryBudgetClearText > 0) {
+            if (g_inpaintModeClearText != InpaintModeClearText::Frontier) {
+                printf("Atentie: --inpaint %s este ignorat cu --memory-budget-mb, se foloseste frontier\n",
+                    g_inpaintModeClearText == InpaintModeClearText::BackgroundModel ? "background" : "reference");
+            }
+            if (params.pyramidFactor > 1) {
+                printf("Atentie: --pyramid este ignorat cu --memory-budget-mb\n");
+            }
+            if (g_useSidecarsClearText) {
+                printf("Atentie: --sidecar este ignorat cu --memory-budget-mb\n");
+            }
+        }
+        return runBatchClearText(args[0], args[1], params);
+    }
 
-int main() {
     int op;
     do {
         system("cls");
@@ -736,6 +6854,8 @@ int main() {
         printf("+ Evidentiire vizuala a selectiei\n");
         printf("\n");
         printf("1 - ClearText cu selectie mouse\n");
+        printf("2 - ClearText pe un folder (pagina urmatoare pregatita in fundal)\n");
+        printf("3 - Reglarea parametrilor de detectie (cursoare)\n");
         printf("0 - Exit\n");
         printf("\n");
         printf("Optiune: ");
@@ -745,6 +6865,12 @@ int main() {
         case 1:
             testClearTextWithMouseSelection();
             break;
+        case 2:
+            transcribeFolderClearText();
+            break;
+        case 3:
+            tuneDetectionParamsClearText();
+            break;
         case 0:
             printf("La revedere!\n");
             break;